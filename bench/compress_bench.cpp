@@ -0,0 +1,142 @@
+// Measures encode/decode throughput and compression ratio of the depth codecs.
+// Usage: compress_bench [recording folder] [codec id]
+// Without a folder, synthetic 640x480 Z16 frames are used. A recording folder is read with
+// RecordingReader, legacy frames without metadata are taken as 640x480 Z16.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../src/rs_compress.h"
+#include "../src/rs_recording.h"
+
+namespace {
+	struct TestFrame {
+		int width;
+		int height;
+		std::vector<char> data;
+	};
+
+	/// Slanted floor, a few boxes at different depths, sensor noise and invalid pixels
+	TestFrame syntheticFrame(std::mt19937& rng, int n) {
+		const int width = 640, height = 480;
+		std::normal_distribution<double> noise(0.0, 2.0);
+		std::uniform_int_distribution<int> hole(0, 99);
+		TestFrame frame = { width, height, std::vector<char>(width * height * 2) };
+		uint16_t* px = reinterpret_cast<uint16_t*>(frame.data.data());
+
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				double depth = 4000.0 - y * 5.0;
+				if (x > 100 + n % 50 && x < 250 + n % 50 && y > 150 && y < 400) {
+					depth = 1200.0 + x * 0.5;
+				}
+				if ((x - 450) * (x - 450) + (y - 200) * (y - 200) < 80 * 80) {
+					depth = 800.0 + std::sqrt((double)((x - 450) * (x - 450) + (y - 200) * (y - 200))) * 2.0;
+				}
+				// disparity based sensors get noisier with distance
+				depth += noise(rng) * depth / 1000.0;
+				px[y * width + x] = hole(rng) < 3 ? 0 : (uint16_t)depth;
+			}
+		}
+		return frame;
+	}
+
+	bool loadRecording(const fs::path& dir, std::vector<TestFrame>& frames) {
+		rsw::RecordingReader reader(dir);
+		for (auto& e : reader.getIndex()) {
+			rsw::FrameHandle handle;
+			if (!reader.map(e.timestamp, handle)) {
+				continue;
+			}
+			TestFrame frame = { handle.width(), handle.height(), std::vector<char>() };
+			if (handle.format() == rs::format::any && handle.size() == 640 * 480 * 2) {
+				frame.width = 640;
+				frame.height = 480;
+			} else if (handle.format() != rs::format::z16 && handle.format() != rs::format::y16 &&
+					handle.format() != rs::format::disparity16) {
+				continue;
+			}
+			frame.data.assign(handle.data(), handle.data() + handle.size());
+			frames.push_back(frame);
+		}
+		return !frames.empty();
+	}
+}
+
+int main(int argc, char** argv) {
+	uint32_t codecId = argc > 2 ? (uint32_t)std::atoi(argv[2]) : (uint32_t)rsw::CODEC_DELTA_RICE;
+	rsw::FrameCodec* codec = rsw::getCodec(codecId);
+	if (codec == nullptr) {
+		std::cerr << "Unknown codec " << codecId << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<TestFrame> frames;
+	if (argc > 1) {
+		if (!loadRecording(argv[1], frames)) {
+			std::cerr << "No 16 bit frames in " << argv[1] << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << "Recording " << argv[1] << ": " << frames.size() << " frames" << std::endl;
+	} else {
+		std::mt19937 rng(42);
+		for (int i = 0; i < 30; ++i) {
+			frames.push_back(syntheticFrame(rng, i));
+		}
+		std::cout << "Synthetic: " << frames.size() << " frames 640x480 Z16" << std::endl;
+	}
+
+	const int passes = 5;
+	std::vector<std::vector<char>> encoded(frames.size());
+	std::vector<char> decoded;
+	uint64_t rawBytes = 0, storedBytes = 0;
+	double encodeSeconds = 0, decodeSeconds = 0;
+
+	for (int pass = 0; pass < passes; ++pass) {
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < frames.size(); ++i) {
+			if (!codec->encode(frames[i].data.data(), frames[i].data.size(), frames[i].width,
+					frames[i].height, encoded[i])) {
+				// stored raw by the writer
+				encoded[i] = frames[i].data;
+			}
+		}
+		encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < frames.size(); ++i) {
+			decoded.resize(frames[i].data.size());
+			if (encoded[i].size() == frames[i].data.size()) {
+				std::memcpy(decoded.data(), encoded[i].data(), decoded.size());
+			} else if (!codec->decode(encoded[i].data(), encoded[i].size(), frames[i].width,
+					frames[i].height, decoded.data(), decoded.size())) {
+				std::cerr << "Decode failed on frame " << i << std::endl;
+				return EXIT_FAILURE;
+			}
+			if (pass == 0 && decoded != frames[i].data) {
+				std::cerr << "Round trip mismatch on frame " << i << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (pass == 0) {
+			for (size_t i = 0; i < frames.size(); ++i) {
+				rawBytes += frames[i].data.size();
+				storedBytes += encoded[i].size();
+			}
+		}
+	}
+
+	double mb = rawBytes * passes / (1024.0 * 1024.0);
+	std::cout << "Ratio:  " << (double)rawBytes / storedBytes << ":1 (" << storedBytes / frames.size() <<
+		" bytes per frame)" << std::endl;
+	std::cout << "Encode: " << mb / encodeSeconds << " MB/s" << std::endl;
+	std::cout << "Decode: " << mb / decodeSeconds << " MB/s" << std::endl;
+	return 0;
+}
@@ -0,0 +1,224 @@
+// Playback throughput of recordings made on simulated devices, no camera needed.
+// Records once through RealSenseWrapper, then reads every frame back with one getFrame per
+// timestamp and with PlaybackSession at 1x, 4x and as fast as possible. Reports frames/s,
+// MB/s, the achieved rate, late frames and read ahead stalls, and checks that sessions
+// deliver every frame in timestamp order and that seeking lands on the right frame.
+//
+// Usage: playback_bench [--dir path] [--seconds n] [--cameras n] [--color] [--width n]
+//                       [--height n] [--fps n] [--buffer n] [--compression id]
+// Defaults to 2 cameras recording depth for 5 s. The recordings are read from the page
+// cache, as they were just written.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/rs_log.h"
+#include "../src/rs_wrapper.h"
+
+namespace {
+	struct BenchConfig {
+		int cameras = 2;
+		bool color = false;
+		int width = 640;
+		int height = 480;
+		int fps = 30;
+		size_t buffer = rsw::DEFAULT_PLAYBACK_BUFFER;
+	};
+
+	/// Reads a byte of every page, as a consumer looking at the pixels would
+	uint64_t touch(const rsw::FrameHandle& frame) {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < frame.size(); i += 4096) {
+			sum += (unsigned char)frame.data()[i];
+		}
+		return sum;
+	}
+
+	void record(rsw::RealSenseWrapper& wrapper, const std::vector<rsw::SimulatedSource*>& sims,
+			const std::vector<std::string>& serials, const BenchConfig& config, double seconds) {
+		for (auto& serial : serials) {
+			wrapper.enableStream(serial, rs::stream::depth, "depth", config.width, config.height,
+				rs::format::z16, config.fps);
+			if (config.color) {
+				wrapper.enableStream(serial, rs::stream::color, "color", config.width, config.height,
+					rs::format::rgb8, config.fps);
+			}
+			wrapper.startDevice(serial);
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		for (auto& serial : serials) {
+			wrapper.stopDevice(serial);
+		}
+		uint64_t captured = 0;
+		for (auto sim : sims) {
+			captured += sim->getFrameCount();
+		}
+		while (true) {
+			rsw::DiskWriter::Stats stats = wrapper.getWriterStats();
+			if (stats.written + stats.dropped + stats.writeErrors >= captured) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void printRow(const char* mode, uint64_t frames, uint64_t bytes, double seconds, double rate,
+			uint64_t late, uint64_t stalls, bool ok) {
+		std::printf("%-12s %8llu %9.1f %9.1f %7.2fx %6llu %7llu %s\n", mode, (unsigned long long)frames,
+			frames / seconds, bytes / seconds / (1024.0 * 1024.0), rate, (unsigned long long)late,
+			(unsigned long long)stalls, ok ? "yes" : "NO");
+		std::fflush(stdout);
+	}
+
+	/// Records, then plays the recordings back in every mode. Returns false if a session
+	/// missed frames, delivered them out of order or did not seek correctly.
+	bool run(const BenchConfig& config, const rsw::DiskWriter::Config& writerConfig, const fs::path& dir,
+			double seconds) {
+		std::vector<rsw::SimulatedSource*> sims;
+		std::vector<rsw::DeviceSource*> sources;
+		std::vector<std::string> serials;
+		std::vector<rsw::StreamId> members;
+		for (int i = 0; i < config.cameras; ++i) {
+			rsw::SimulatedSource::Config sim;
+			sim.jitter = 2.0;
+			sim.seed = i + 1;
+			char serial[16];
+			std::snprintf(serial, sizeof(serial), "sim%04d", i);
+			serials.push_back(serial);
+			sims.push_back(new rsw::SimulatedSource(serial, sim));
+			sources.push_back(sims.back());
+			members.push_back({ serial, rs::stream::depth, "depth" });
+			if (config.color) {
+				members.push_back({ serial, rs::stream::color, "color" });
+			}
+		}
+
+		rsw::RealSenseWrapper wrapper(dir.string(), sources, writerConfig);
+		std::cout << "Recording " << members.size() << " streams for " << seconds << " s to " << dir << std::endl;
+		record(wrapper, sims, serials, config, seconds);
+
+		std::vector<std::vector<int>> timestamps(members.size());
+		uint64_t total = 0;
+		for (size_t m = 0; m < members.size(); ++m) {
+			wrapper.getTimestamps(timestamps[m], members[m].serial, members[m].stream, members[m].name,
+				0, 0x7fffffff);
+			total += timestamps[m].size();
+		}
+		std::printf("%llu frames recorded, buffer of %zu frames\n", (unsigned long long)total, config.buffer);
+		std::printf("%-12s %8s %9s %9s %8s %6s %7s %s\n", "mode", "frames", "frames/s", "MB/s", "rate", "late",
+			"stalls", "in order");
+
+		// what replays did before sessions, one lookup per recorded timestamp
+		volatile uint64_t sink = 0;
+		uint64_t bytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t m = 0; m < members.size(); ++m) {
+			for (int t : timestamps[m]) {
+				rsw::FrameHandle frame;
+				if (wrapper.getFrame(frame, members[m].serial, members[m].stream, members[m].name, t) ==
+						rsw::RealSenseWrapper::NO_ERROR) {
+					sink += touch(frame);
+					bytes += frame.size();
+				}
+			}
+		}
+		double getFrameSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printRow("getFrame", total, bytes, getFrameSeconds, 0.0, 0, 0, true);
+
+		bool allOk = true;
+		for (double rate : { 1.0, 4.0, 0.0 }) {
+			rsw::PlaybackSession* session = nullptr;
+			if (wrapper.openPlayback(&session, members, rate, config.buffer) != rsw::RealSenseWrapper::NO_ERROR) {
+				std::cerr << "Unable to open playback" << std::endl;
+				return false;
+			}
+			rsw::PlaybackFrame frame;
+			uint64_t count = 0;
+			int last = -1;
+			bool ordered = true;
+			while (session->next(frame)) {
+				sink += touch(frame.frame);
+				ordered = ordered && frame.frame.timestamp() >= last;
+				last = frame.frame.timestamp();
+				++count;
+			}
+			rsw::PlaybackStats stats = session->getStats();
+			bool ok = ordered && count == total;
+			allOk = allOk && ok;
+			char mode[16];
+			std::snprintf(mode, sizeof(mode), rate > 0.0 ? "session %gx" : "session max", rate);
+			printRow(mode, stats.frames, stats.bytes, stats.seconds, stats.rate, stats.late, stats.stalls, ok);
+
+			if (rate == 0.0) {
+				// seek to the middle, then back to the start
+				int middle = session->getStartTimestamp() + (session->getEndTimestamp() - session->getStartTimestamp()) / 2;
+				session->seek(middle);
+				bool seeked = session->next(frame) && frame.frame.timestamp() >= middle;
+				session->seek(session->getStartTimestamp());
+				seeked = seeked && session->next(frame) && frame.frame.timestamp() == session->getStartTimestamp();
+				std::printf("seek %s\n", seeked ? "ok" : "FAILED");
+				allOk = allOk && seeked;
+			}
+			delete session;
+		}
+
+		return allOk;
+	}
+}
+
+int main(int argc, char** argv) {
+	fs::path dir = fs::temp_directory_path() / "rswrapper_playback_bench";
+	double seconds = 5.0;
+	BenchConfig config;
+	rsw::DiskWriter::Config writerConfig;
+	rsw::setLogLevel(rsw::LOG_WARN);
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--color") {
+			config.color = true;
+			continue;
+		}
+		if (value == nullptr) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (arg == "--dir") {
+			dir = value;
+		} else if (arg == "--seconds") {
+			seconds = std::atof(value);
+		} else if (arg == "--cameras") {
+			config.cameras = std::atoi(value);
+		} else if (arg == "--width") {
+			config.width = std::atoi(value);
+		} else if (arg == "--height") {
+			config.height = std::atoi(value);
+		} else if (arg == "--fps") {
+			config.fps = std::atoi(value);
+		} else if (arg == "--buffer") {
+			config.buffer = std::atoi(value);
+		} else if (arg == "--compression") {
+			writerConfig.compression = std::atoi(value);
+		} else {
+			std::cerr << "Unknown option " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (config.cameras <= 0 || seconds <= 0.0) {
+		std::cerr << "Need at least one camera and a positive recording time" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	bool ok = run(config, writerConfig, dir, seconds);
+	fs::remove_all(dir);
+	return ok ? 0 : EXIT_FAILURE;
+}
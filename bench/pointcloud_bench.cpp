@@ -0,0 +1,179 @@
+// Measures whole frame deprojection at every SIMD level the CPU supports and with several
+// worker threads, with and without registering to a color camera. Checks that all levels
+// match the scalar code and that the scalar code matches librealsense's rsutil functions.
+// Usage: pointcloud_bench [width height] [iterations]
+// Defaults to 640x480 and 200 iterations per configuration.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <rsutil.h>
+
+#include "../src/rs_convert.h"
+#include "../src/rs_pointcloud.h"
+
+namespace {
+	// R200 like cameras, a wide depth camera with inverse distortion and a color camera 25mm
+	// to its side with forward distortion
+	rsw::StreamCalibration makeCalibration(int width, int height, bool color) {
+		static const float depthCoeffs[5] = { 0.04f, -0.03f, 0.0005f, 0.0007f, 0.0f };
+		static const float colorCoeffs[5] = { -0.05f, 0.06f, 0.0008f, -0.0005f, 0.0f };
+		rsw::StreamCalibration c;
+		c.intrinsics.width = width;
+		c.intrinsics.height = height;
+		c.intrinsics.fx = width * (color ? 1.1f : 0.85f);
+		c.intrinsics.fy = c.intrinsics.fx;
+		c.intrinsics.ppx = width / 2.0f + 1.5f;
+		c.intrinsics.ppy = height / 2.0f - 2.0f;
+		c.intrinsics.model = color ? RS_DISTORTION_MODIFIED_BROWN_CONRADY : RS_DISTORTION_INVERSE_BROWN_CONRADY;
+		std::memcpy(c.intrinsics.coeffs, color ? colorCoeffs : depthCoeffs, sizeof(c.intrinsics.coeffs));
+		// slightly turned, so the rotation is not the identity
+		const float angle = 0.01f;
+		float rotation[9] = { std::cos(angle), 0, -std::sin(angle), 0, 1, 0, std::sin(angle), 0, std::cos(angle) };
+		std::memcpy(c.toDepth.rotation, rotation, sizeof(rotation));
+		c.toDepth.translation[0] = color ? 0.025f : 0.0f;
+		c.toDepth.translation[1] = 0.0f;
+		c.toDepth.translation[2] = 0.0f;
+		if (!color) {
+			for (int i = 0; i < 9; ++i) {
+				c.toDepth.rotation[i] = i % 4 == 0 ? 1.0f : 0.0f;
+			}
+		}
+		c.depthScale = 0.001f;
+		return c;
+	}
+
+	struct Cloud {
+		std::vector<float> x, y, z, u, v;
+		rsw::PointCloud view;
+
+		Cloud(size_t n) : x(n), y(n), z(n), u(n), v(n) {
+			view = { x.data(), y.data(), z.data(), u.data(), v.data() };
+		}
+		bool operator==(const Cloud& o) const {
+			return x == o.x && y == o.y && z == o.z && u == o.u && v == o.v;
+		}
+	};
+
+	/// Largest difference to rsutil over all pixels with depth, in meters and color pixels
+	void compareToRsutil(const rsw::StreamCalibration& depthCal, const rsw::StreamCalibration& colorCal,
+		const std::vector<uint16_t>& depth, const Cloud& cloud, bool registered, double& maxPoint, double& maxPixel) {
+		rs_extrinsics colorToDepth = colorCal.toDepth;
+		// invert the color to depth rotation and translation
+		rs_extrinsics depthToColor;
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				depthToColor.rotation[c * 3 + r] = colorToDepth.rotation[r * 3 + c];
+			}
+		}
+		for (int r = 0; r < 3; ++r) {
+			depthToColor.translation[r] = -(depthToColor.rotation[r] * colorToDepth.translation[0] +
+				depthToColor.rotation[3 + r] * colorToDepth.translation[1] + depthToColor.rotation[6 + r] * colorToDepth.translation[2]);
+		}
+
+		maxPoint = 0.0;
+		maxPixel = 0.0;
+		int width = depthCal.intrinsics.width;
+		for (size_t i = 0; i < depth.size(); ++i) {
+			if (depth[i] == 0) {
+				continue;
+			}
+			float pixel[2] = { (float)(i % width), (float)(i / width) };
+			float point[3];
+			rs_deproject_pixel_to_point(point, &depthCal.intrinsics, pixel, depth[i] * depthCal.depthScale);
+			if (registered) {
+				float colorPoint[3];
+				rs_transform_point_to_point(colorPoint, &depthToColor, point);
+				std::memcpy(point, colorPoint, sizeof(point));
+				float colorPixel[2];
+				rs_project_point_to_pixel(colorPixel, &colorCal.intrinsics, point);
+				if (cloud.u[i] != -1.0f) {
+					maxPixel = std::max(maxPixel, (double)std::abs(colorPixel[0] - cloud.u[i]));
+					maxPixel = std::max(maxPixel, (double)std::abs(colorPixel[1] - cloud.v[i]));
+				}
+			}
+			maxPoint = std::max(maxPoint, (double)std::abs(point[0] - cloud.x[i]));
+			maxPoint = std::max(maxPoint, (double)std::abs(point[1] - cloud.y[i]));
+			maxPoint = std::max(maxPoint, (double)std::abs(point[2] - cloud.z[i]));
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int width = argc > 2 ? std::atoi(argv[1]) : 640;
+	int height = argc > 2 ? std::atoi(argv[2]) : 480;
+	int iterations = argc > 3 ? std::atoi(argv[3]) : argc == 2 ? std::atoi(argv[1]) : 200;
+	if (width <= 0 || height <= 0 || iterations <= 0) {
+		std::fprintf(stderr, "Usage: pointcloud_bench [width height] [iterations]\n");
+		return EXIT_FAILURE;
+	}
+	size_t pixels = (size_t)width * height;
+
+	// depths in the range of the sensor, some without data
+	std::mt19937 rng(1);
+	std::vector<uint16_t> depth(pixels);
+	for (auto& d : depth) {
+		d = rng() % 50 == 0 ? 0 : (uint16_t)(300 + rng() % 5000);
+	}
+	rsw::StreamCalibration depthCal = makeCalibration(width, height, false);
+	rsw::StreamCalibration colorCal = makeCalibration(width, height, true);
+
+	rsw::SimdLevel best = rsw::getSupportedSimdLevel();
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::printf("%dx%d, %d iterations, cpu supports %s, %d cores\n", width, height, iterations,
+		rsw::getSimdLevelName(best), cores);
+	std::printf("%-10s %-7s %7s %9s %10s %8s %s\n", "mode", "level", "threads", "ms/frame", "MPoint/s", "speedup",
+		"matches scalar");
+
+	bool allMatch = true;
+	for (int registered = 0; registered < 2; ++registered) {
+		Cloud reference(pixels);
+		double scalarMs = 0.0;
+		std::vector<int> threadCounts = { 1 };
+		for (int t = 2; t <= std::max(cores, 4); t *= 2) {
+			threadCounts.push_back(t);
+		}
+
+		for (int level = rsw::SIMD_SCALAR; level <= best; ++level) {
+			rsw::setSimdLevel((rsw::SimdLevel)level);
+			// only the best level is worth trying with more threads
+			size_t configs = level == best ? threadCounts.size() : 1;
+			for (size_t c = 0; c < configs; ++c) {
+				int threads = threadCounts[c];
+				std::unique_ptr<rsw::PointCloudGenerator> generator(registered ?
+					new rsw::PointCloudGenerator(depthCal, colorCal, threads) : new rsw::PointCloudGenerator(depthCal, threads));
+				Cloud cloud(pixels);
+				Cloud& target = level == rsw::SIMD_SCALAR ? reference : cloud;
+				auto start = std::chrono::steady_clock::now();
+				for (int i = 0; i < iterations; ++i) {
+					generator->generate(depth.data(), target.view);
+				}
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+					iterations;
+				if (level == rsw::SIMD_SCALAR) {
+					scalarMs = ms;
+				}
+				bool match = level == rsw::SIMD_SCALAR || cloud == reference;
+				allMatch = allMatch && match;
+				std::printf("%-10s %-7s %7d %9.3f %10.1f %7.2fx %s\n", registered ? "registered" : "depth",
+					rsw::getSimdLevelName((rsw::SimdLevel)level), threads, ms, pixels / ms / 1000.0, scalarMs / ms,
+					match ? "yes" : "NO");
+			}
+		}
+
+		double maxPoint;
+		double maxPixel;
+		compareToRsutil(depthCal, colorCal, depth, reference, registered != 0, maxPoint, maxPixel);
+		std::printf("largest difference to rsutil: %.3g m, %.3g px\n", maxPoint, maxPixel);
+		allMatch = allMatch && maxPoint < 1e-4 && maxPixel < 1e-2;
+	}
+	rsw::setSimdLevel(rsw::SIMD_AVX2);
+	return allMatch ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,165 @@
+// Checks that a sync group pairs frames of two devices whose clocks neither share an offset
+// nor run at the same rate. Both simulated devices record depth while grouped, then every
+// frameset is read back with getFrameset. The simulated devices derive their timestamps
+// from when a frame was due on the host clock, so each frame's host time can be recovered
+// from its device timestamp and compared with that of the frame it was paired with. The
+// skew is exaggerated: the clock of the second device runs slow, so the smallest offset
+// ever seen is the one from its first frames, and keeping it would misplace its later
+// frames by more than the tolerance. Framesets late in the recording only pair correctly
+// if the clock models' windows moved on.
+//
+// Usage: sync_check [--dir path] [--seconds n] [--skew ppm] [--tolerance ms]
+// Defaults to 15 s at +-2000 ppm with DEFAULT_SYNC_TOLERANCE.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/rs_log.h"
+#include "../src/rs_wrapper.h"
+
+namespace {
+	const int WIDTH = 320;
+	const int HEIGHT = 240;
+	const int FPS = 30;
+	// frames before the clock models only keep estimates based on frames after the skew
+	// built up, well past the first CLOCK_WINDOW frames
+	const size_t SETTLED = 4 * rsw::CLOCK_WINDOW;
+
+	/// Milliseconds after the device started that the frame was due, on the host clock
+	double hostTime(int timestamp, const rsw::SimulatedSource::Config& config) {
+		return (timestamp - config.clockOffset) / (1.0 + config.clockSkew);
+	}
+
+	bool run(const fs::path& dir, double seconds, double skew, int tolerance) {
+		std::vector<rsw::SimulatedSource::Config> configs(2);
+		configs[0].jitter = 2.0;
+		configs[0].clockOffset = 0;
+		configs[0].clockSkew = skew;
+		configs[0].seed = 1;
+		configs[1].jitter = 2.0;
+		configs[1].clockOffset = 100000;
+		configs[1].clockSkew = -skew;
+		configs[1].seed = 2;
+
+		std::vector<rsw::SimulatedSource*> sims;
+		std::vector<rsw::DeviceSource*> sources;
+		std::vector<rsw::StreamId> members;
+		for (size_t i = 0; i < configs.size(); ++i) {
+			char serial[16];
+			std::snprintf(serial, sizeof(serial), "sim%04d", (int)i);
+			sims.push_back(new rsw::SimulatedSource(serial, configs[i]));
+			sources.push_back(sims.back());
+			members.push_back({ serial, rs::stream::depth, "depth" });
+		}
+
+		rsw::RealSenseWrapper wrapper(dir.string(), sources);
+		for (auto& m : members) {
+			wrapper.enableStream(m.serial, m.stream, m.name, WIDTH, HEIGHT, rs::format::z16, FPS);
+		}
+		if (wrapper.addSyncGroup("pair", members, tolerance) != rsw::RealSenseWrapper::NO_ERROR) {
+			std::cerr << "Unable to add the sync group" << std::endl;
+			return false;
+		}
+		// started back to back, the devices' host time origins are well under a frame apart
+		for (auto& m : members) {
+			wrapper.startDevice(m.serial);
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		for (auto& m : members) {
+			wrapper.stopDevice(m.serial);
+		}
+		uint64_t captured = 0;
+		for (auto sim : sims) {
+			captured += sim->getFrameCount();
+		}
+		while (true) {
+			rsw::DiskWriter::Stats stats = wrapper.getWriterStats();
+			if (stats.written + stats.dropped + stats.writeErrors >= captured) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::vector<int> timestamps;
+		wrapper.getTimestamps(timestamps, members[0].serial, members[0].stream, members[0].name, 0, 0x7fffffff);
+		uint64_t framesets = 0;
+		uint64_t unpaired = 0;
+		uint64_t mismatched = 0;
+		uint64_t settled = 0;
+		double worst = 0.0;
+		for (size_t i = 0; i < timestamps.size(); ++i) {
+			std::vector<rsw::FrameHandle> frames;
+			if (wrapper.getFrameset(frames, timestamps[i], members, rsw::TimestampIndex::EXACT) !=
+					rsw::RealSenseWrapper::NO_ERROR) {
+				// the last frames may still have been waiting on a later frame of the other device
+				continue;
+			}
+			++framesets;
+			if (frames[1].empty()) {
+				++unpaired;
+				continue;
+			}
+			double distance = std::abs(hostTime(frames[0].timestamp(), configs[0]) -
+				hostTime(frames[1].timestamp(), configs[1]));
+			worst = std::max(worst, distance);
+			if (distance > tolerance) {
+				++mismatched;
+				std::printf("frame %d paired with %d, %.1f ms apart\n", frames[0].timestamp(),
+					frames[1].timestamp(), distance);
+			}
+			if (i >= SETTLED) {
+				++settled;
+			}
+		}
+
+		double drift = seconds * 1000.0 * 2.0 * skew;
+		std::printf("%zu frames, %llu framesets, %llu unpaired, %llu mismatched, %llu paired after %zu frames\n",
+			timestamps.size(), (unsigned long long)framesets, (unsigned long long)unpaired,
+			(unsigned long long)mismatched, (unsigned long long)settled, SETTLED);
+		std::printf("device clocks drifted %.1f ms apart, paired frames at most %.1f ms apart, tolerance %d ms\n",
+			drift, worst, tolerance);
+		// at the same framerate every frame has a partner well within tolerance
+		return framesets > 0 && unpaired == 0 && mismatched == 0 && settled > 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	fs::path dir = fs::temp_directory_path() / "rswrapper_sync_check";
+	double seconds = 15.0;
+	double skew = 2e-3;
+	int tolerance = rsw::DEFAULT_SYNC_TOLERANCE;
+	rsw::setLogLevel(rsw::LOG_WARN);
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		const char* value = argv[i + 1];
+		if (arg == "--dir") {
+			dir = value;
+		} else if (arg == "--seconds") {
+			seconds = std::atof(value);
+		} else if (arg == "--skew") {
+			skew = std::atof(value) * 1e-6;
+		} else if (arg == "--tolerance") {
+			tolerance = std::atoi(value);
+		} else {
+			std::cerr << "Unknown option " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (argc % 2 == 0 || seconds <= 0.0 || tolerance < 0) {
+		std::cerr << "Usage: sync_check [--dir path] [--seconds n] [--skew ppm] [--tolerance ms]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	bool ok = run(dir, seconds, skew, tolerance);
+	fs::remove_all(dir);
+	return ok ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,254 @@
+// End-to-end recording throughput on simulated devices, no camera needed.
+// Every configuration records for a while through RealSenseWrapper and reports sustained
+// frames/s, MB/s, capture to disk latency percentiles, dropped frames and CPU usage.
+//
+// Usage: throughput_bench [--dir path] [--seconds n] [--cameras n] [--color] [--width n]
+//                         [--height n] [--fps n] [--jitter ms] [--drop fraction] [--threads n]
+//                         [--queue n] [--policy block|drop-oldest|drop-newest] [--compression id]
+//                         [--batch n] [--direct] [--preallocate] [--sync-ms n] [--sync-mb n]
+//                         [--metrics file] [--log trace|debug|info|warn|error|off]
+// Without --cameras, 1, 4 and 8 cameras are run with depth only and with depth and color.
+// --metrics dumps per-stream metrics in the Prometheus text format every second, the file
+// ends up holding those of the last configuration.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <ctime>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../src/rs_log.h"
+#include "../src/rs_wrapper.h"
+
+namespace {
+	struct BenchConfig {
+		int cameras;
+		bool color;
+		int width = 640;
+		int height = 480;
+		int fps = 30;
+		double jitter = 2.0;
+		double drop = 0.0;
+	};
+
+	struct Result {
+		double seconds;
+		rsw::DiskWriter::Stats stats;
+		uint64_t captured;
+		uint64_t simulatedDrops;
+		double cpu;
+	};
+
+	/// CPU time of all threads of the process, in seconds
+	double cpuSeconds() {
+#ifdef _WIN32
+		return (double)std::clock() / CLOCKS_PER_SEC;
+#else
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+	}
+
+	Result run(const BenchConfig& config, const rsw::DiskWriter::Config& writerConfig,
+			const fs::path& dir, double seconds, const std::string& metricsFile) {
+		fs::remove_all(dir);
+		fs::create_directories(dir);
+
+		std::vector<rsw::SimulatedSource*> sims;
+		std::vector<rsw::DeviceSource*> sources;
+		std::vector<std::string> serials;
+		for (int i = 0; i < config.cameras; ++i) {
+			rsw::SimulatedSource::Config sim;
+			sim.jitter = config.jitter;
+			sim.dropRate = config.drop;
+			sim.clockOffset = i * 1000;
+			sim.seed = i + 1;
+			char serial[16];
+			std::snprintf(serial, sizeof(serial), "sim%04d", i);
+			serials.push_back(serial);
+			sims.push_back(new rsw::SimulatedSource(serial, sim));
+			sources.push_back(sims.back());
+		}
+
+		Result result;
+		rsw::RealSenseWrapper wrapper(dir.string(), sources, writerConfig);
+		if (!metricsFile.empty() && wrapper.startMetricsDump(metricsFile, 1000) != rsw::RealSenseWrapper::NO_ERROR) {
+			std::cerr << "Unable to write metrics to " << metricsFile << std::endl;
+		}
+		for (auto& serial : serials) {
+			wrapper.enableStream(serial, rs::stream::depth, "depth", config.width, config.height,
+				rs::format::z16, config.fps);
+			if (config.color) {
+				wrapper.enableStream(serial, rs::stream::color, "color", config.width, config.height,
+					rs::format::rgb8, config.fps);
+			}
+		}
+
+		for (auto& serial : serials) {
+			wrapper.startDevice(serial);
+		}
+		// the capture threads apply the modes first, which makes simulated devices generate their frames
+		for (auto sim : sims) {
+			while (sim->getFrameCount() == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		rsw::DiskWriter::Stats startStats = wrapper.getWriterStats();
+		double cpuStart = cpuSeconds();
+		auto start = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		for (auto& serial : serials) {
+			wrapper.stopDevice(serial);
+		}
+
+		result.captured = 0;
+		result.simulatedDrops = 0;
+		for (auto sim : sims) {
+			result.captured += sim->getFrameCount();
+			result.simulatedDrops += sim->getDropCount();
+		}
+		// wait until every captured frame is written or dropped
+		while (true) {
+			result.stats = wrapper.getWriterStats();
+			if (result.stats.written + result.stats.dropped + result.stats.writeErrors >= result.captured) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.stats.written -= startStats.written;
+		result.stats.rawBytes -= startStats.rawBytes;
+		result.stats.storedBytes -= startStats.storedBytes;
+		result.cpu = (cpuSeconds() - cpuStart) / result.seconds * 100.0;
+		// leaves the final totals in the file
+		wrapper.stopMetricsDump();
+		return result;
+	}
+
+	void printHeader() {
+		std::printf("%4s %-11s %9s %9s %9s %8s %8s %8s %8s %8s %8s %6s\n", "cams", "streams", "frames/s",
+			"MB/s in", "MB/s disk", "p50 ms", "p90 ms", "p99 ms", "max ms", "drop sim", "drop q", "cpu %");
+	}
+
+	void printResult(const BenchConfig& config, const Result& r) {
+		const double MB = 1024.0 * 1024.0;
+		char streams[32];
+		std::snprintf(streams, sizeof(streams), "%s %dx%d@%d", config.color ? "d+c" : "d",
+			config.width, config.height, config.fps);
+		std::printf("%4d %-11s %9.1f %9.1f %9.1f %8.2f %8.2f %8.2f %8.2f %8llu %8llu %6.1f\n",
+			config.cameras, streams, r.stats.written / r.seconds, r.stats.rawBytes / MB / r.seconds,
+			r.stats.storedBytes / MB / r.seconds, r.stats.latencyP50 / 1000.0, r.stats.latencyP90 / 1000.0,
+			r.stats.latencyP99 / 1000.0, r.stats.latencyMax / 1000.0,
+			(unsigned long long)r.simulatedDrops, (unsigned long long)r.stats.dropped, r.cpu);
+		std::fflush(stdout);
+	}
+}
+
+int main(int argc, char** argv) {
+	fs::path dir = fs::temp_directory_path() / "rswrapper_bench";
+	double seconds = 10.0;
+	BenchConfig base = { 0, false };
+	rsw::DiskWriter::Config writerConfig;
+	std::string metricsFile;
+	// the wrapper's device and catalog messages would break up the table
+	rsw::setLogLevel(rsw::LOG_WARN);
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--color") {
+			base.color = true;
+			continue;
+		}
+		if (arg == "--direct") {
+			writerConfig.io.direct = true;
+			continue;
+		}
+		if (arg == "--preallocate") {
+			writerConfig.io.preallocate = true;
+			continue;
+		}
+		if (value == nullptr) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (arg == "--dir") {
+			dir = value;
+		} else if (arg == "--seconds") {
+			seconds = std::atof(value);
+		} else if (arg == "--cameras") {
+			base.cameras = std::atoi(value);
+		} else if (arg == "--width") {
+			base.width = std::atoi(value);
+		} else if (arg == "--height") {
+			base.height = std::atoi(value);
+		} else if (arg == "--fps") {
+			base.fps = std::atoi(value);
+		} else if (arg == "--jitter") {
+			base.jitter = std::atof(value);
+		} else if (arg == "--drop") {
+			base.drop = std::atof(value);
+		} else if (arg == "--threads") {
+			writerConfig.threads = std::atoi(value);
+		} else if (arg == "--queue") {
+			writerConfig.queueCapacity = std::atoi(value);
+		} else if (arg == "--policy") {
+			std::string policy = value;
+			writerConfig.policy = policy == "drop-oldest" ? rsw::FrameQueue::DROP_OLDEST :
+				policy == "drop-newest" ? rsw::FrameQueue::DROP_NEWEST : rsw::FrameQueue::BLOCK;
+		} else if (arg == "--compression") {
+			writerConfig.compression = std::atoi(value);
+		} else if (arg == "--batch") {
+			writerConfig.batchSize = std::atoi(value);
+		} else if (arg == "--sync-ms") {
+			writerConfig.io.syncIntervalMs = std::atoi(value);
+		} else if (arg == "--sync-mb") {
+			writerConfig.io.syncBytes = std::strtoull(value, nullptr, 10) * 1024 * 1024;
+		} else if (arg == "--metrics") {
+			metricsFile = value;
+		} else if (arg == "--log") {
+			std::string level = value;
+			rsw::setLogLevel(level == "trace" ? rsw::LOG_TRACE : level == "debug" ? rsw::LOG_DEBUG :
+				level == "info" ? rsw::LOG_INFO : level == "error" ? rsw::LOG_ERROR :
+				level == "off" ? rsw::LOG_OFF : rsw::LOG_WARN);
+		} else {
+			std::cerr << "Unknown option " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<BenchConfig> configs;
+	if (base.cameras > 0) {
+		configs.push_back(base);
+	} else {
+		for (int cameras : { 1, 4, 8 }) {
+			for (bool color : { false, true }) {
+				BenchConfig config = base;
+				config.cameras = cameras;
+				config.color = color;
+				configs.push_back(config);
+			}
+		}
+	}
+
+	std::cout << "Writing to " << dir << ", " << seconds << " s per configuration, " << writerConfig.threads <<
+		" writer threads" << (writerConfig.io.direct ? ", direct I/O" : "") << std::endl;
+	printHeader();
+	for (auto& config : configs) {
+		printResult(config, run(config, writerConfig, dir, seconds, metricsFile));
+	}
+	fs::remove_all(dir);
+	return 0;
+}
@@ -0,0 +1,165 @@
+// Checks that closing a recording survives a full DROP_OLDEST writer queue. The writer
+// thread is held inside its written callback while the queue fills up behind a close
+// marker, so frames submitted afterwards have to evict older ones. The marker must not be
+// among them: the recording's segments have to be closed and its catalog entry finished.
+// Then records several streams through RealSenseWrapper, whose rings keep the latest frames
+// of each stream, and checks that the writer's pool never has to allocate a frame, neither
+// while the rings fill up nor once they are full.
+//
+// Usage: writer_check [--dir path]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/rs_catalog.h"
+#include "../src/rs_log.h"
+#include "../src/rs_wrapper.h"
+#include "../src/rs_writer.h"
+
+namespace {
+	const int WIDTH = 64;
+	const int HEIGHT = 48;
+
+	fs::path recordingPath(const fs::path& dir, const std::string& serial) {
+		return dir / serial / rs_stream_to_string(RS_STREAM_DEPTH) / "depth";
+	}
+
+	void submit(rsw::DiskWriter& writer, const fs::path& recording, int timestamp) {
+		auto frame = writer.acquireFrame(WIDTH * HEIGHT * 2);
+		frame->recording = recording;
+		frame->stream = rs::stream::depth;
+		frame->format = rs::format::z16;
+		frame->width = WIDTH;
+		frame->height = HEIGHT;
+		frame->timestamp = timestamp;
+		writer.submit(frame);
+	}
+
+	bool run(const fs::path& dir) {
+		const size_t capacity = 4;
+		fs::path closing = recordingPath(dir, "sim0");
+		// shares the writer queue with closing, its frames do the evicting
+		fs::path other = recordingPath(dir, "sim1");
+		// created by enableStream when recording through the wrapper
+		fs::create_directories(closing);
+		fs::create_directories(other);
+
+		rsw::Catalog catalog(dir);
+		rsw::RecordingInfo info = { "sim0", rs::stream::depth, "depth", rs::format::z16, WIDTH, HEIGHT, 30,
+			0, -1, -1, true };
+		catalog.beginRecording(info);
+
+		rsw::DiskWriter::Config config;
+		config.threads = 1;
+		config.queueCapacity = capacity;
+		config.policy = rsw::FrameQueue::DROP_OLDEST;
+		config.frameCapacity = WIDTH * HEIGHT * 2;
+		config.segmentSize = 1024 * 1024;
+		rsw::DiskWriter writer(config);
+
+		std::mutex gate;
+		std::atomic<bool> closed(false);
+		writer.setWrittenCallback([&gate](const fs::path&, int) {
+			std::lock_guard<std::mutex> lock(gate);
+		});
+		writer.setClosedCallback([&](const fs::path& p) {
+			catalog.finishRecording(p);
+			if (p == closing) {
+				closed = true;
+			}
+		});
+
+		gate.lock();
+		// the writer thread takes the first frame and then waits on the gate
+		submit(writer, closing, 0);
+		while (writer.getStats().queueDepth > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		submit(writer, closing, 33);
+		submit(writer, closing, 66);
+		writer.closeRecording(closing);
+		for (size_t i = 0; i < capacity * 2; ++i) {
+			submit(writer, other, (int)i * 33);
+		}
+		uint64_t dropped = writer.getStats().dropped;
+		gate.unlock();
+		writer.shutdown();
+
+		bool finished = false;
+		for (auto& rec : catalog.getRecordings()) {
+			if (rec.serial == "sim0") {
+				finished = !rec.recording;
+			}
+		}
+		std::printf("%llu frames dropped, close marker %s, catalog entry %s\n", (unsigned long long)dropped,
+			closed ? "written" : "LOST", finished ? "finished" : "STILL RECORDING");
+		return dropped > 0 && closed && finished && writer.getStats().writeErrors == 0;
+	}
+
+	bool runPool(const fs::path& dir) {
+		const int cameras = 3;
+		std::vector<rsw::DeviceSource*> sources;
+		std::vector<std::string> serials;
+		for (int i = 0; i < cameras; ++i) {
+			rsw::SimulatedSource::Config sim;
+			sim.seed = i + 1;
+			char serial[16];
+			std::snprintf(serial, sizeof(serial), "pool%04d", i);
+			serials.push_back(serial);
+			sources.push_back(new rsw::SimulatedSource(serial, sim));
+		}
+
+		// the queue and batch hold far fewer frames than the rings, the pool is sized for both
+		rsw::DiskWriter::Config config;
+		config.threads = 1;
+		config.queueCapacity = 16;
+		config.batchSize = 8;
+		config.frameCapacity = WIDTH * HEIGHT * 3;
+		rsw::RealSenseWrapper wrapper(dir.string(), sources, config);
+		for (auto& serial : serials) {
+			wrapper.enableStream(serial, rs::stream::depth, "depth", WIDTH, HEIGHT, rs::format::z16, 30);
+			wrapper.enableStream(serial, rs::stream::color, "color", WIDTH, HEIGHT, rs::format::rgb8, 30);
+			wrapper.startDevice(serial);
+		}
+		// until every ring is full
+		std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+		rsw::DiskWriter::Stats warm = wrapper.getWriterStats();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+		rsw::DiskWriter::Stats stats = wrapper.getWriterStats();
+		for (auto& serial : serials) {
+			wrapper.stopDevice(serial);
+		}
+
+		std::printf("%llu frames written, pool allocations %llu after warm up, %llu at the end\n",
+			(unsigned long long)stats.written, (unsigned long long)warm.poolAllocations,
+			(unsigned long long)stats.poolAllocations);
+		return stats.written > warm.written && warm.poolAllocations == 0 &&
+			stats.poolAllocations == warm.poolAllocations;
+	}
+}
+
+int main(int argc, char** argv) {
+	fs::path dir = fs::temp_directory_path() / "rswrapper_writer_check";
+	if (argc == 3 && std::string(argv[1]) == "--dir") {
+		dir = argv[2];
+	} else if (argc != 1) {
+		std::fprintf(stderr, "Usage: writer_check [--dir path]\n");
+		return EXIT_FAILURE;
+	}
+	rsw::setLogLevel(rsw::LOG_WARN);
+
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	bool ok = run(dir);
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	ok = runPool(dir) && ok;
+	fs::remove_all(dir);
+	return ok ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,299 @@
+#include <stdexcept>
+#include <sstream>
+
+#include "rs_capture.h"
+#include "rs_log.h"
+
+namespace rsw {
+	CaptureEngine::CaptureEngine(DeviceSource* dev, std::mutex* devM) :
+								 _dev(dev), _devM(devM), _streams(), _consumers(), _calibrations(),
+								 _nextId(0), _dirty(false), _running(false), _dispatching(false), _error(),
+								 _thread(nullptr) {
+	}
+
+	CaptureEngine::~CaptureEngine() {
+		stop();
+	}
+
+	int CaptureEngine::addConsumer(StreamConfig config, FrameCallback callback, CalibrationCallback calibrated) {
+		std::lock_guard<std::mutex> lock(_m);
+		auto existing = _streams.find(config.stream);
+		if (existing != _streams.end()) {
+			const StreamConfig& c = existing->second;
+			if (c.width != config.width || c.height != config.height ||
+					c.format != config.format || c.framerate != config.framerate) {
+				return -1;
+			}
+		} else {
+			_streams[config.stream] = config;
+			_dirty = true;
+		}
+
+		int id = _nextId++;
+		// the capture thread delivers the calibration, writing it may take a while
+		_consumers[id] = std::make_shared<Consumer>(Consumer { config.stream, callback, calibrated, true });
+		_cv.notify_all();
+		return id;
+	}
+
+	void CaptureEngine::removeConsumer(int id) {
+		std::unique_lock<std::mutex> lock(_m);
+		auto consumer = _consumers.find(id);
+		if (consumer == _consumers.end()) {
+			return;
+		}
+		rs::stream strm = consumer->second->stream;
+		_consumers.erase(consumer);
+
+		bool shared = false;
+		for (const auto& c : _consumers) {
+			shared = shared || c.second->stream == strm;
+		}
+		if (!shared) {
+			// last consumer of this stream, disable it on the device
+			_streams.erase(strm);
+			_calibrations.erase(strm);
+			_dirty = true;
+			_cv.notify_all();
+		}
+
+		// a dispatch in progress may still call the consumer, unless this is one of its calls
+		if (_thread == nullptr || _thread->get_id() != std::this_thread::get_id()) {
+			_cv.wait(lock, [this] { return !_dispatching; });
+		}
+	}
+
+	void CaptureEngine::start() {
+		std::unique_lock<std::mutex> lock(_m);
+		if (_running) {
+			return;
+		}
+		// a thread that stopped on an error is done but still has to be joined
+		std::thread* failed = _thread;
+		_thread = nullptr;
+		lock.unlock();
+		if (failed != nullptr) {
+			failed->join();
+			delete failed;
+		}
+
+		lock.lock();
+		if (_running) {
+			return;
+		}
+		_running = true;
+		_dirty = true;
+		_error.clear();
+		_thread = new std::thread(&CaptureEngine::captureLoop, this);
+	}
+
+	void CaptureEngine::stop() {
+		_m.lock();
+		std::thread* thread = _thread;
+		_thread = nullptr;
+		_running = false;
+		_m.unlock();
+		_cv.notify_all();
+
+		if (thread != nullptr) {
+			thread->join();
+			delete thread;
+		}
+	}
+
+	bool CaptureEngine::isRunning() {
+		std::lock_guard<std::mutex> lock(_m);
+		return _running;
+	}
+
+	std::string CaptureEngine::getError() {
+		std::lock_guard<std::mutex> lock(_m);
+		return _error;
+	}
+
+	void CaptureEngine::applyConfig(const std::map<rs::stream, StreamConfig>& streams,
+		std::map<rs::stream, StreamCalibration>& calibrations) {
+		std::lock_guard<std::mutex> lock(*_devM);
+		if (_dev->isStreaming()) {
+			_dev->stop();
+		}
+		for (int i = 0; i < RS_STREAM_COUNT; ++i) {
+			rs::stream strm = (rs::stream)i;
+			if (streams.count(strm) == 0 && _dev->isStreamEnabled(strm)) {
+				_dev->disableStream(strm);
+			}
+		}
+		for (auto s : streams) {
+			const StreamConfig& c = s.second;
+			_dev->enableStream(c.stream, c.width, c.height, c.format, c.framerate);
+		}
+		for (auto s : streams) {
+			StreamCalibration calibration;
+			try {
+				calibration.intrinsics = _dev->getStreamIntrinsics(s.first);
+				calibration.depthScale = _dev->getDepthScale();
+			} catch (const std::runtime_error& e) {
+				RSW_LOG(LOG_WARN, "No calibration for " << rs_stream_to_string((rs_stream)s.first) << " on " <<
+					_dev->getSerial() << ": " << e.what());
+				continue;
+			}
+			try {
+				calibration.toDepth = _dev->getExtrinsics(s.first, rs::stream::depth);
+			} catch (const std::runtime_error&) {
+				// devices without a depth camera, nothing to relate to
+				calibration.toDepth = rs_extrinsics { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+			}
+			calibrations[s.first] = calibration;
+		}
+		if (!streams.empty()) {
+			_dev->start();
+		}
+	}
+
+	void CaptureEngine::captureLoop() {
+		std::map<rs::stream, StreamConfig> applied;
+		std::map<rs::stream, int> lastTimestamps;
+		std::map<rs::stream, std::pair<int, const void*>> frames;
+		// copied under _m and called without it
+		std::vector<std::shared_ptr<Consumer>> targets;
+		std::vector<std::pair<std::shared_ptr<Consumer>, StreamCalibration>> calibrated;
+		std::string error;
+
+		try {
+			while (true) {
+				std::unique_lock<std::mutex> lock(_m);
+				_cv.wait(lock, [&] { return !_running || _dirty || !applied.empty(); });
+				if (!_running) {
+					break;
+				}
+				if (_dirty) {
+					applied = _streams;
+					_dirty = false;
+					lock.unlock();
+					std::map<rs::stream, StreamCalibration> calibrations;
+					applyConfig(applied, calibrations);
+					lastTimestamps.clear();
+
+					lock.lock();
+					// streams changed meanwhile are configured again on the next pass
+					_calibrations.clear();
+					for (const auto& c : calibrations) {
+						auto current = _streams.find(c.first);
+						const StreamConfig& a = applied[c.first];
+						if (current != _streams.end() && current->second.width == a.width &&
+								current->second.height == a.height && current->second.format == a.format &&
+								current->second.framerate == a.framerate) {
+							_calibrations[c.first] = c.second;
+						}
+					}
+					for (const auto& c : _consumers) {
+						c.second->pending = true;
+					}
+					continue;
+				}
+
+				// consumers added since are told the calibration of their stream first
+				calibrated.clear();
+				for (const auto& c : _consumers) {
+					if (!c.second->pending || applied.count(c.second->stream) == 0) {
+						continue;
+					}
+					c.second->pending = false;
+					auto calibration = _calibrations.find(c.second->stream);
+					if (c.second->calibrated && calibration != _calibrations.end()) {
+						calibrated.push_back(std::make_pair(c.second, calibration->second));
+					}
+				}
+				_dispatching = !calibrated.empty();
+				lock.unlock();
+				for (const auto& c : calibrated) {
+					c.first->calibrated(c.second);
+				}
+				if (!calibrated.empty()) {
+					calibrated.clear();
+					lock.lock();
+					_dispatching = false;
+					lock.unlock();
+					_cv.notify_all();
+				}
+
+				_dev->waitForFrames();
+
+				// Collect the streams that actually have a new frame in this frameset
+				frames.clear();
+				std::unique_lock<std::mutex> devLock(*_devM);
+				for (auto s : applied) {
+					int timestamp = _dev->getFrameTimestamp(s.first);
+					auto last = lastTimestamps.find(s.first);
+					if (last == lastTimestamps.end() || last->second != timestamp) {
+						const void* data = _dev->getFrameData(s.first);
+						if (data == nullptr) {
+							// no frame of this stream yet
+							continue;
+						}
+						lastTimestamps[s.first] = timestamp;
+						frames[s.first] = std::make_pair(timestamp, data);
+					}
+				}
+				devLock.unlock();
+
+				// Frame data stays valid until the next wait_for_frames, which only this thread calls.
+				// Consumers may block, on a full disk writer queue for one, so they are called
+				// without _m, only removing a consumer waits for them.
+				lock.lock();
+				targets.clear();
+				for (const auto& c : _consumers) {
+					if (frames.count(c.second->stream) != 0) {
+						targets.push_back(c.second);
+					}
+				}
+				_dispatching = !targets.empty();
+				lock.unlock();
+				if (targets.empty()) {
+					continue;
+				}
+				for (const auto& c : targets) {
+					const auto& frame = frames[c->stream];
+					c->callback(applied[c->stream], frame.first, frame.second);
+				}
+				targets.clear();
+				lock.lock();
+				_dispatching = false;
+				lock.unlock();
+				_cv.notify_all();
+			}
+		} catch (const rs::error& e) {
+			std::ostringstream message;
+			message << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() <<
+				"): " << e.what();
+			error = message.str();
+		} catch (const std::runtime_error& e) {
+			error = e.what();
+		}
+		if (!error.empty()) {
+			RSW_LOG(LOG_ERROR, "Capture stopped on " << _dev->getSerial() << ": " << error);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(*_devM);
+			try {
+				if (_dev->isStreaming()) {
+					_dev->stop();
+				}
+			} catch (const std::runtime_error& e) {
+				RSW_LOG(LOG_ERROR, e.what());
+			}
+		}
+
+		_m.lock();
+		// a consumer that threw left its dispatch unfinished
+		_dispatching = false;
+		if (!error.empty()) {
+			// the device is stopped, start() may now join this thread and capture again
+			_running = false;
+			_error = error;
+		}
+		_m.unlock();
+		_cv.notify_all();
+	}
+}
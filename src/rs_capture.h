@@ -0,0 +1,93 @@
+#ifndef RSCAPTURE_H
+#define RSCAPTURE_H
+
+#include <map>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <rs.hpp>
+
+#include "rs_device_source.h"
+#include "rs_recording.h"
+
+namespace rsw {
+	/// Owns the capture loop of a single device. One thread blocks on wait_for_frames and
+	/// hands every new frame to all consumers of that stream. Adding or removing consumers
+	/// reconfigures the device from the capture thread between framesets, after which every
+	/// consumer is told the calibration of its stream.
+	class CaptureEngine {
+	public:
+		struct StreamConfig {
+			rs::stream stream;
+			int width;
+			int height;
+			rs::format format;
+			int framerate;
+		};
+
+		/// Called on the capture thread without any lock held, data is only valid for the
+		/// duration of the call
+		typedef std::function<void(const StreamConfig&, int timestamp, const void* data)> FrameCallback;
+		/// Called on the capture thread once the stream is configured, and again whenever the
+		/// device is reconfigured
+		typedef std::function<void(const StreamCalibration&)> CalibrationCallback;
+
+		/// devM guards all other access to the device and is held while reconfiguring it
+		/// or reading frame data
+		CaptureEngine(DeviceSource* dev, std::mutex* devM);
+		~CaptureEngine();
+
+		/// Returns a consumer id, or -1 if the stream is already enabled in another mode
+		int addConsumer(StreamConfig config, FrameCallback callback,
+			CalibrationCallback calibrated = CalibrationCallback());
+		/// Waits for callbacks being dispatched, once this returns the consumer is never
+		/// called again
+		void removeConsumer(int id);
+
+		/// Restarts the capture thread if it stopped on an error
+		void start();
+		void stop();
+		/// False once the capture thread stopped on an error, see getError
+		bool isRunning();
+		/// Returns why the capture thread last stopped on its own, empty if it did not
+		std::string getError();
+
+	private:
+		struct Consumer {
+			rs::stream stream;
+			FrameCallback callback;
+			CalibrationCallback calibrated;
+			// the calibration of the stream as configured now was not delivered yet
+			bool pending;
+		};
+
+		DeviceSource* _dev;
+		std::mutex* _devM;
+		std::map<rs::stream, StreamConfig> _streams;
+		// shared with the capture thread while it calls them
+		std::map<int, std::shared_ptr<Consumer>> _consumers;
+		// of the streams as last configured on the device
+		std::map<rs::stream, StreamCalibration> _calibrations;
+		int _nextId;
+		bool _dirty;
+		bool _running;
+		// the capture thread is calling consumers
+		bool _dispatching;
+		std::string _error;
+		std::mutex _m;
+		std::condition_variable _cv;
+		std::thread* _thread;
+
+		void captureLoop();
+		/// Fills calibrations with those of the enabled streams the device reports
+		void applyConfig(const std::map<rs::stream, StreamConfig>& streams,
+			std::map<rs::stream, StreamCalibration>& calibrations);
+	};
+}
+
+#endif
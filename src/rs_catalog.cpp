@@ -0,0 +1,285 @@
+#include <sstream>
+#include <ios>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include "rs_catalog.h"
+#include "rs_log.h"
+#include "rs_recording.h"
+
+namespace rsw {
+	static const char* CATALOG_HEADER = "# rswrapper catalog 1";
+
+	Catalog::Catalog(fs::path dataPath) : _path(dataPath / "catalog.rscat"), _dataPath(dataPath),
+										  _devices(), _m() {
+		if (!load()) {
+			_devices.clear();
+			RSW_LOG(LOG_INFO, "Building recording catalog for " << _dataPath);
+			walk();
+			save();
+			return;
+		}
+
+		// Recordings still marked as in progress were interrupted, nothing is live at startup
+		bool changed = false;
+		for (auto& device : _devices) {
+			for (auto& rec : device.second) {
+				if (rec.second.recording) {
+					rec.second.recording = false;
+					inspect(_dataPath / device.first / rs_stream_to_string((rs_stream)rec.first.first) /
+						rec.first.second, rec.second);
+					changed = true;
+				}
+			}
+		}
+		if (changed) {
+			save();
+		}
+	}
+
+	std::vector<RecordingInfo> Catalog::getRecordings() {
+		std::lock_guard<std::mutex> lock(_m);
+		std::vector<RecordingInfo> out;
+		for (auto& device : _devices) {
+			for (auto& rec : device.second) {
+				out.push_back(rec.second);
+			}
+		}
+		return out;
+	}
+
+	std::vector<std::string> Catalog::getSerials() {
+		std::lock_guard<std::mutex> lock(_m);
+		std::vector<std::string> out;
+		for (auto& device : _devices) {
+			out.push_back(device.first);
+		}
+		return out;
+	}
+
+	void Catalog::addDevice(const std::string& serial) {
+		std::lock_guard<std::mutex> lock(_m);
+		if (_devices.count(serial) == 0) {
+			_devices[serial];
+			save();
+		}
+	}
+
+	void Catalog::beginRecording(const RecordingInfo& info) {
+		std::lock_guard<std::mutex> lock(_m);
+		RecordingInfo& rec = _devices[info.serial][Key((int)info.stream, info.name)];
+		rec = info;
+		rec.recording = true;
+		save();
+	}
+
+	void Catalog::finishRecording(const fs::path& dir) {
+		std::string name = dir.filename().string();
+		int strm = streamFromName(dir.parent_path().filename().string());
+		std::string serial = dir.parent_path().parent_path().filename().string();
+
+		std::lock_guard<std::mutex> lock(_m);
+		auto device = _devices.find(serial);
+		if (device == _devices.end()) {
+			return;
+		}
+		auto rec = device->second.find(Key(strm, name));
+		if (rec == device->second.end()) {
+			return;
+		}
+		rec->second.recording = false;
+		inspect(dir, rec->second);
+		save();
+	}
+
+	int Catalog::verify() {
+		std::lock_guard<std::mutex> lock(_m);
+		int stale = walk();
+		if (stale > 0) {
+			save();
+		}
+		return stale;
+	}
+
+	void Catalog::rebuild() {
+		std::lock_guard<std::mutex> lock(_m);
+		// keep recordings in progress, their folders may not have any frames yet
+		std::map<std::string, std::map<Key, RecordingInfo>> live;
+		for (auto& device : _devices) {
+			for (auto& rec : device.second) {
+				if (rec.second.recording) {
+					live[device.first][rec.first] = rec.second;
+				}
+			}
+		}
+		_devices = live;
+		walk();
+		save();
+	}
+
+	int Catalog::walk() {
+		int stale = 0;
+		std::map<std::string, std::map<Key, RecordingInfo>> found;
+		auto isDir = [](const fs::directory_entry& e) {
+			boost::system::error_code ec;
+			return fs::is_directory(e.path(), ec);
+		};
+
+		for (auto& serialDir : fs::directory_iterator(_dataPath)) {
+			if (!isDir(serialDir)) {
+				continue;
+			}
+			std::string serial = serialDir.path().filename().string();
+			auto& recordings = found[serial];
+			auto known = _devices.find(serial);
+
+			for (auto& streamDir : fs::directory_iterator(serialDir.path())) {
+				if (!isDir(streamDir)) {
+					continue;
+				}
+				int strm = streamFromName(streamDir.path().filename().string());
+				if (strm == -1) {
+					continue;
+				}
+
+				for (auto& nameDir : fs::directory_iterator(streamDir.path())) {
+					if (!isDir(nameDir)) {
+						continue;
+					}
+					Key key(strm, nameDir.path().filename().string());
+					if (known != _devices.end()) {
+						auto rec = known->second.find(key);
+						// an existing entry is checked against its mapped index, frames are not listed
+						if (rec != known->second.end() && (rec->second.recording ||
+								TimestampIndex(nameDir.path()).size() == rec->second.frameCount)) {
+							recordings[key] = rec->second;
+							continue;
+						}
+					}
+
+					RecordingInfo info = { serial, (rs::stream)strm, key.second, rs::format::any,
+						0, 0, 0, 0, -1, -1, false };
+					inspect(nameDir.path(), info);
+					recordings[key] = info;
+					++stale;
+				}
+			}
+		}
+
+		// entries whose folders are gone
+		for (auto& device : _devices) {
+			auto now = found.find(device.first);
+			for (auto& rec : device.second) {
+				if (now == found.end() || now->second.count(rec.first) == 0) {
+					if (rec.second.recording) {
+						found[device.first][rec.first] = rec.second;
+					} else {
+						++stale;
+					}
+				}
+			}
+		}
+
+		_devices = found;
+		return stale;
+	}
+
+	int Catalog::streamFromName(const std::string& name) {
+		// stream folders are named by rs_stream_to_string
+		for (int i = 0; i < RS_STREAM_COUNT; ++i) {
+			if (name == rs_stream_to_string((rs_stream)i)) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	void Catalog::inspect(const fs::path& dir, RecordingInfo& info) {
+		RecordingReader reader(dir);
+		const TimestampIndex& index = reader.getIndex();
+		info.frameCount = index.size();
+		if (index.size() == 0) {
+			info.firstTimestamp = info.lastTimestamp = -1;
+			return;
+		}
+		info.firstTimestamp = index.begin()->timestamp;
+		info.lastTimestamp = (index.end() - 1)->timestamp;
+
+		// segmented recordings carry the image layout in every frame header
+		FrameHandle frame;
+		if (reader.map(info.firstTimestamp, frame) && frame.format() != rs::format::any) {
+			info.format = frame.format();
+			info.width = frame.width();
+			info.height = frame.height();
+		}
+		if (info.framerate == 0 && info.lastTimestamp > info.firstTimestamp) {
+			// timestamps are in milliseconds
+			info.framerate = (int)((info.frameCount - 1) * 1000.0 /
+				(info.lastTimestamp - info.firstTimestamp) + 0.5);
+		}
+	}
+
+	bool Catalog::load() {
+		fs::ifstream ifs(_path);
+		std::string line;
+		if (!std::getline(ifs, line) || line != CATALOG_HEADER) {
+			return false;
+		}
+
+		while (std::getline(ifs, line)) {
+			std::istringstream fields(line);
+			std::string type, serial;
+			std::getline(fields, type, '\t');
+			std::getline(fields, serial, '\t');
+			if (type == "D") {
+				_devices[serial];
+			} else if (type == "R") {
+				RecordingInfo info;
+				int strm, fmt, recording;
+				info.serial = serial;
+				fields >> strm;
+				fields.ignore(1);
+				std::getline(fields, info.name, '\t');
+				fields >> fmt >> info.width >> info.height >> info.framerate >> info.frameCount >>
+					info.firstTimestamp >> info.lastTimestamp >> recording;
+				if (!fields) {
+					return false;
+				}
+				info.stream = (rs::stream)strm;
+				info.format = (rs::format)fmt;
+				info.recording = recording != 0;
+				_devices[serial][Key(strm, info.name)] = info;
+			}
+		}
+		return true;
+	}
+
+	void Catalog::save() {
+		// Write to a temporary file first so a crash never leaves a truncated catalog
+		fs::path tmp = _path;
+		tmp += ".tmp";
+		{
+			fs::ofstream ofs(tmp, std::ios::out | std::ios::trunc);
+			ofs << CATALOG_HEADER << '\n';
+			for (auto& device : _devices) {
+				ofs << "D\t" << device.first << '\n';
+				for (auto& rec : device.second) {
+					const RecordingInfo& i = rec.second;
+					ofs << "R\t" << i.serial << '\t' << (int)i.stream << '\t' << i.name << '\t' <<
+						(int)i.format << '\t' << i.width << '\t' << i.height << '\t' << i.framerate << '\t' <<
+						i.frameCount << '\t' << i.firstTimestamp << '\t' << i.lastTimestamp << '\t' <<
+						(i.recording ? 1 : 0) << '\n';
+				}
+			}
+			if (!ofs) {
+				RSW_LOG(LOG_ERROR, "Unable to write catalog " << tmp);
+				return;
+			}
+		}
+		boost::system::error_code ec;
+		fs::rename(tmp, _path, ec);
+		if (ec) {
+			RSW_LOG(LOG_ERROR, "Unable to write catalog " << _path << ": " << ec.message());
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef RSCATALOG_H
+#define RSCATALOG_H
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <utility>
+#include <string>
+#include <mutex>
+
+#include <boost/filesystem.hpp>
+#include <rs.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	/// Summary of one recording folder dataPath/serial/stream/name
+	struct RecordingInfo {
+		std::string serial;
+		rs::stream stream;
+		std::string name;
+		rs::format format;
+		int width;
+		int height;
+		int framerate;
+		uint64_t frameCount;
+		int firstTimestamp;
+		int lastTimestamp;
+		// true while the recording is being written
+		bool recording;
+	};
+
+	/// Persistent list of the recordings under a data directory, kept in a text file at its
+	/// root so startup and status queries do not walk the directory tree. Updated as
+	/// recordings start and finish; verify() and rebuild() repair a stale catalog.
+	class Catalog {
+	public:
+		/// Loads the catalog, rebuilding it if the file is missing or unreadable
+		Catalog(fs::path dataPath);
+
+		std::vector<RecordingInfo> getRecordings();
+		std::vector<std::string> getSerials();
+
+		/// Adds a device with no recordings yet
+		void addDevice(const std::string& serial);
+		void beginRecording(const RecordingInfo& info);
+		/// Refreshes frame count and time range of the recording in folder
+		/// dataPath/serial/stream/name from its timestamp index
+		void finishRecording(const fs::path& dir);
+
+		/// Walks device, stream and name folders (not frames), adding missing recordings,
+		/// dropping vanished ones and refreshing entries whose index changed.
+		/// Returns the number of entries that were stale.
+		int verify();
+		/// Discards the catalog and builds it again from the directory tree
+		void rebuild();
+
+	private:
+		// stream and recording name within one device
+		typedef std::pair<int, std::string> Key;
+
+		fs::path _path;
+		fs::path _dataPath;
+		// devices without recordings map to an empty map
+		std::map<std::string, std::map<Key, RecordingInfo>> _devices;
+		std::mutex _m;
+
+		bool load();
+		void save();
+		int walk();
+		/// Fills format, size and time range from the recording on disk
+		static void inspect(const fs::path& dir, RecordingInfo& info);
+		/// Returns the stream whose folder name is name, or -1
+		static int streamFromName(const std::string& name);
+	};
+}
+
+#endif
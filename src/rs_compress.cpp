@@ -0,0 +1,294 @@
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RSW_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "rs_compress.h"
+
+namespace rsw {
+	namespace {
+		const int BLOCK_SIZE = 64;
+		const int MAX_RICE_K = 15;
+		// unary quotients from here on escape to a raw 16 bit value
+		const uint32_t ESCAPE_QUOTIENT = 24;
+
+		inline int countTrailingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+			unsigned long i;
+			_BitScanForward64(&i, v);
+			return (int)i;
+#else
+			return __builtin_ctzll(v);
+#endif
+		}
+
+		inline uint16_t zigzag(uint16_t v) {
+			int16_t r = (int16_t)v;
+			return (uint16_t)((r << 1) ^ (r >> 15));
+		}
+
+		inline uint16_t unzigzag(uint16_t v) {
+			return (uint16_t)((v >> 1) ^ (0 - (v & 1)));
+		}
+
+		/// JPEG-LS median edge detector
+		inline uint16_t predictMed(uint16_t a, uint16_t b, uint16_t c) {
+			uint16_t mn = a < b ? a : b;
+			uint16_t mx = a < b ? b : a;
+			if (c >= mx) {
+				return mn;
+			}
+			if (c <= mn) {
+				return mx;
+			}
+			return (uint16_t)(a + b - c);
+		}
+
+		/// Writes zigzagged prediction residuals of one row
+		void rowResiduals(const uint16_t* cur, const uint16_t* prev, uint16_t* out, int width) {
+			if (prev == nullptr) {
+				out[0] = zigzag(cur[0]);
+				for (int x = 1; x < width; ++x) {
+					out[x] = zigzag((uint16_t)(cur[x] - cur[x - 1]));
+				}
+				return;
+			}
+
+			out[0] = zigzag((uint16_t)(cur[0] - prev[0]));
+			int x = 1;
+#ifdef RSW_HAVE_SSE2
+			// min/max are signed in SSE2, so compare in a space biased by 0x8000
+			const __m128i bias = _mm_set1_epi16((short)0x8000);
+			for (; x + 8 <= width; x += 8) {
+				__m128i a = _mm_loadu_si128((const __m128i*)(cur + x - 1));
+				__m128i b = _mm_loadu_si128((const __m128i*)(prev + x));
+				__m128i c = _mm_loadu_si128((const __m128i*)(prev + x - 1));
+				__m128i v = _mm_loadu_si128((const __m128i*)(cur + x));
+
+				__m128i as = _mm_xor_si128(a, bias);
+				__m128i bs = _mm_xor_si128(b, bias);
+				__m128i cs = _mm_xor_si128(c, bias);
+				__m128i mn = _mm_min_epi16(as, bs);
+				__m128i mx = _mm_max_epi16(as, bs);
+				__m128i cGeMax = _mm_or_si128(_mm_cmpgt_epi16(cs, mx), _mm_cmpeq_epi16(cs, mx));
+				__m128i cLeMin = _mm_or_si128(_mm_cmplt_epi16(cs, mn), _mm_cmpeq_epi16(cs, mn));
+				__m128i grad = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+
+				__m128i pred = _mm_or_si128(_mm_and_si128(cLeMin, _mm_xor_si128(mx, bias)),
+					_mm_andnot_si128(cLeMin, grad));
+				pred = _mm_or_si128(_mm_and_si128(cGeMax, _mm_xor_si128(mn, bias)),
+					_mm_andnot_si128(cGeMax, pred));
+
+				__m128i r = _mm_sub_epi16(v, pred);
+				__m128i zz = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+				_mm_storeu_si128((__m128i*)(out + x), zz);
+			}
+#endif
+			for (; x < width; ++x) {
+				out[x] = zigzag((uint16_t)(cur[x] - predictMed(cur[x - 1], prev[x], prev[x - 1])));
+			}
+		}
+
+		class BitWriter {
+		public:
+			BitWriter(std::vector<char>& out) : _out(out), _acc(0), _bits(0) {}
+
+			/// n must be at most 32
+			void put(uint32_t value, int n) {
+				_acc |= (uint64_t)value << _bits;
+				_bits += n;
+				if (_bits >= 32) {
+					uint32_t word = (uint32_t)_acc;
+					char bytes[4];
+					std::memcpy(bytes, &word, 4);
+					_out.insert(_out.end(), bytes, bytes + 4);
+					_acc >>= 32;
+					_bits -= 32;
+				}
+			}
+
+			void finish() {
+				while (_bits > 0) {
+					_out.push_back((char)(_acc & 0xff));
+					_acc >>= 8;
+					_bits -= 8;
+				}
+			}
+
+		private:
+			std::vector<char>& _out;
+			uint64_t _acc;
+			int _bits;
+		};
+
+		class BitReader {
+		public:
+			BitReader(const char* data, size_t size) : _data((const unsigned char*)data), _size(size),
+													   _pos(0), _acc(0), _bits(0), _overrun(false) {}
+
+			uint32_t get(int n) {
+				if (_bits < n) {
+					refill();
+					if (_bits < n) {
+						_overrun = true;
+						return 0;
+					}
+				}
+				uint32_t v = (uint32_t)(_acc & ((1ull << n) - 1));
+				_acc >>= n;
+				_bits -= n;
+				return v;
+			}
+
+			/// Returns the number of zeros before the next one bit and consumes them both
+			uint32_t getUnary() {
+				if (_bits <= (int)ESCAPE_QUOTIENT) {
+					refill();
+				}
+				uint64_t window = _bits >= 64 ? _acc : (_acc & ((1ull << _bits) - 1));
+				if (window == 0) {
+					_overrun = true;
+					return ESCAPE_QUOTIENT;
+				}
+				uint32_t q = (uint32_t)countTrailingZeros(window);
+				_acc >>= q + 1;
+				_bits -= q + 1;
+				return q;
+			}
+
+			bool overrun() const { return _overrun; }
+
+		private:
+			const unsigned char* _data;
+			size_t _size;
+			size_t _pos;
+			uint64_t _acc;
+			int _bits;
+			bool _overrun;
+
+			void refill() {
+				while (_bits <= 56 && _pos < _size) {
+					_acc |= (uint64_t)_data[_pos++] << _bits;
+					_bits += 8;
+				}
+			}
+		};
+	}
+
+	bool DeltaRiceCodec::supports(rs::format fmt) const {
+		return fmt == rs::format::z16 || fmt == rs::format::disparity16 || fmt == rs::format::y16;
+	}
+
+	bool DeltaRiceCodec::encode(const char* src, size_t size, int width, int height,
+			std::vector<char>& out) {
+		size_t count = (size_t)width * height;
+		if (width <= 0 || height <= 0 || size != count * 2) {
+			return false;
+		}
+
+		// reused across frames of the same writer thread
+		thread_local std::vector<uint16_t> residuals;
+		residuals.resize(count);
+		const uint16_t* pixels = reinterpret_cast<const uint16_t*>(src);
+		for (int y = 0; y < height; ++y) {
+			rowResiduals(pixels + (size_t)y * width, y == 0 ? nullptr : pixels + (size_t)(y - 1) * width,
+				residuals.data() + (size_t)y * width, width);
+		}
+
+		out.clear();
+		out.reserve(size / 2);
+		BitWriter bits(out);
+		for (size_t i = 0; i < count; i += BLOCK_SIZE) {
+			size_t end = std::min(count, i + BLOCK_SIZE);
+			uint32_t sum = 0;
+			for (size_t j = i; j < end; ++j) {
+				sum += residuals[j];
+			}
+			// pick k so that 2^k is about the mean residual of the block
+			int k = 0;
+			while (k < MAX_RICE_K && ((uint32_t)(end - i) << k) < sum) {
+				++k;
+			}
+			bits.put(k, 4);
+
+			for (size_t j = i; j < end; ++j) {
+				uint32_t v = residuals[j];
+				uint32_t q = v >> k;
+				if (q < ESCAPE_QUOTIENT) {
+					bits.put(1u << q, q + 1);
+					bits.put(v & ((1u << k) - 1), k);
+				} else {
+					bits.put(1u << ESCAPE_QUOTIENT, ESCAPE_QUOTIENT + 1);
+					bits.put(v, 16);
+				}
+			}
+			// give up early once the output is no smaller than the input
+			if (out.size() >= size) {
+				return false;
+			}
+		}
+		bits.finish();
+		return out.size() < size;
+	}
+
+	bool DeltaRiceCodec::decode(const char* src, size_t size, int width, int height,
+			char* dst, size_t dstSize) {
+		size_t count = (size_t)width * height;
+		if (width <= 0 || height <= 0 || dstSize != count * 2) {
+			return false;
+		}
+
+		uint16_t* pixels = reinterpret_cast<uint16_t*>(dst);
+		BitReader bits(src, size);
+		int k = 0;
+		for (size_t i = 0; i < count; ++i) {
+			if (i % BLOCK_SIZE == 0) {
+				k = (int)bits.get(4);
+			}
+			uint32_t q = bits.getUnary();
+			uint32_t v = (q < ESCAPE_QUOTIENT) ? ((q << k) | bits.get(k)) : bits.get(16);
+			uint16_t r = unzigzag((uint16_t)v);
+
+			size_t x = i % width;
+			uint16_t pred;
+			if (i < (size_t)width) {
+				pred = x == 0 ? 0 : pixels[i - 1];
+			} else if (x == 0) {
+				pred = pixels[i - width];
+			} else {
+				pred = predictMed(pixels[i - 1], pixels[i - width], pixels[i - width - 1]);
+			}
+			pixels[i] = (uint16_t)(pred + r);
+		}
+		return !bits.overrun();
+	}
+
+	namespace {
+		std::map<uint32_t, FrameCodec*>& codecs() {
+			static std::map<uint32_t, FrameCodec*> registry = { { CODEC_DELTA_RICE, new DeltaRiceCodec() } };
+			return registry;
+		}
+		std::mutex codecsM;
+	}
+
+	FrameCodec* getCodec(uint32_t id) {
+		std::lock_guard<std::mutex> lock(codecsM);
+		auto codec = codecs().find(id);
+		return codec == codecs().end() ? nullptr : codec->second;
+	}
+
+	bool registerCodec(FrameCodec* codec) {
+		std::lock_guard<std::mutex> lock(codecsM);
+		// replacing a codec would free it under writer threads and readers still using it
+		return codecs().insert(std::make_pair(codec->getId(), codec)).second;
+	}
+}
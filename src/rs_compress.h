@@ -0,0 +1,56 @@
+#ifndef RSCOMPRESS_H
+#define RSCOMPRESS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <rs.hpp>
+
+namespace rsw {
+	/// Codec ids stored in the flags of a FrameRecordHeader, 0 means uncompressed
+	enum CodecId {
+		CODEC_NONE = 0,
+		CODEC_DELTA_RICE = 1
+	};
+	const uint32_t CODEC_FLAG_MASK = 0xff;
+
+	/// Lossless codec for frame payloads. Codecs are looked up by id when reading, so a
+	/// recording can be decoded by any build that registered the same codec.
+	class FrameCodec {
+	public:
+		virtual ~FrameCodec() {}
+
+		virtual uint32_t getId() const = 0;
+		virtual bool supports(rs::format fmt) const = 0;
+
+		/// Replaces out with the compressed frame. Returns false if the frame does not get
+		/// smaller, in which case it should be stored raw.
+		virtual bool encode(const char* src, size_t size, int width, int height,
+			std::vector<char>& out) = 0;
+		/// dst must hold the uncompressed frame. Returns false on corrupt input.
+		virtual bool decode(const char* src, size_t size, int width, int height,
+			char* dst, size_t dstSize) = 0;
+	};
+
+	/// 16 bit formats (Z16, DISPARITY16, Y16). Each pixel is predicted from its left, upper
+	/// and upper left neighbours (JPEG-LS median edge detector) and the residuals are Rice
+	/// coded with a parameter picked per block of 64 pixels. Residuals are computed with
+	/// SSE2 where available.
+	class DeltaRiceCodec : public FrameCodec {
+	public:
+		uint32_t getId() const { return CODEC_DELTA_RICE; }
+		bool supports(rs::format fmt) const;
+		bool encode(const char* src, size_t size, int width, int height, std::vector<char>& out);
+		bool decode(const char* src, size_t size, int width, int height, char* dst, size_t dstSize);
+	};
+
+	/// Returns the codec registered under id, or nullptr. Registered codecs are never
+	/// freed, the pointer stays valid without holding any lock.
+	FrameCodec* getCodec(uint32_t id);
+	/// Makes a codec available for reading and writing and takes ownership. Returns false,
+	/// leaving codec to the caller, if another one is already registered under its id.
+	bool registerCodec(FrameCodec* codec);
+}
+
+#endif
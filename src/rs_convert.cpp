@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "rs_simd.h"
+#include "rs_convert.h"
+
+namespace rsw {
+	static SimdLevel detectSimdLevel() {
+#if defined(RSW_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool ssse3 = (info[2] & (1 << 9)) != 0;
+		// the OS has to save the AVX registers too
+		bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		bool avx2 = false;
+		if (avx && maxLeaf >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		return avx2 ? SIMD_AVX2 : ssse3 ? SIMD_SSSE3 : sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#elif defined(RSW_X86)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+			__builtin_cpu_supports("ssse3") ? SIMD_SSSE3 :
+			__builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+		return SIMD_SCALAR;
+#endif
+	}
+
+	static std::atomic<int>& levelLimit() {
+		static std::atomic<int> limit(SIMD_AVX2);
+		return limit;
+	}
+
+	SimdLevel getSupportedSimdLevel() {
+		static const SimdLevel level = detectSimdLevel();
+		return level;
+	}
+
+	SimdLevel getSimdLevel() {
+		return (SimdLevel)std::min(levelLimit().load(std::memory_order_relaxed), (int)getSupportedSimdLevel());
+	}
+
+	SimdLevel setSimdLevel(SimdLevel level) {
+		levelLimit() = level;
+		return getSimdLevel();
+	}
+
+	const char* getSimdLevelName(SimdLevel level) {
+		switch (level) {
+		case SIMD_SSE2: return "sse2";
+		case SIMD_SSSE3: return "ssse3";
+		case SIMD_AVX2: return "avx2";
+		default: return "scalar";
+		}
+	}
+
+	static inline uint8_t clampByte(int v) {
+		return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+	}
+
+	// r and b are the offsets of red and blue within an output pixel
+	static void yuyvScalar(const uint8_t* src, uint8_t* dst, size_t pixels, int r, int b) {
+		for (size_t i = 0; i + 1 < pixels; i += 2) {
+			int d = src[1] - 128;
+			int e = src[3] - 128;
+			for (int k = 0; k < 2; ++k) {
+				int c = src[2 * k] - 16;
+				dst[r] = clampByte((298 * c + 409 * e + 128) >> 8);
+				dst[1] = clampByte((298 * c - 100 * d - 208 * e + 128) >> 8);
+				dst[b] = clampByte((298 * c + 516 * d + 128) >> 8);
+				dst += 3;
+			}
+			src += 4;
+		}
+	}
+
+	static void swapRedBlueScalar(const uint8_t* src, uint8_t* dst, size_t pixels) {
+		for (size_t i = 0; i < pixels; ++i) {
+			uint8_t r = src[0];
+			uint8_t g = src[1];
+			dst[0] = src[2];
+			dst[1] = g;
+			dst[2] = r;
+			src += 3;
+			dst += 3;
+		}
+	}
+
+	static void unpackRaw10Scalar(const uint8_t* src, uint16_t* dst, size_t pixels) {
+		for (size_t i = 0; i + 3 < pixels; i += 4) {
+			// the fifth byte holds the 2 low bits of all four pixels, the first one's at the bottom
+			uint8_t low = src[4];
+			for (int k = 0; k < 4; ++k) {
+				dst[k] = (uint16_t)((src[k] << 8) | (((low >> (2 * k)) & 3) << 6));
+			}
+			src += 5;
+			dst += 4;
+		}
+	}
+
+	static void y16ToY8Scalar(const uint16_t* src, uint8_t* dst, size_t pixels) {
+		for (size_t i = 0; i < pixels; ++i) {
+			dst[i] = (uint8_t)(src[i] >> 8);
+		}
+	}
+
+#ifdef RSW_X86
+	// Spreads 16 planar bytes of r, g and b over 48 bytes of packed pixels, [output][channel]
+	alignas(16) static const int8_t RGB_SHUFFLE[3][3][16] = {
+		{ { 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5 },
+		  { -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1 },
+		  { -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 } },
+		{ { -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1 },
+		  { 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10 },
+		  { -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1 } },
+		{ { -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+		  { -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+		  { 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 } }
+	};
+
+	RSW_TARGET("ssse3") static inline void storeRgb16(__m128i r, __m128i g, __m128i b, uint8_t* dst) {
+		for (int k = 0; k < 3; ++k) {
+			__m128i out = _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(r, _mm_load_si128((const __m128i*)RGB_SHUFFLE[k][0])),
+					_mm_shuffle_epi8(g, _mm_load_si128((const __m128i*)RGB_SHUFFLE[k][1]))),
+				_mm_shuffle_epi8(b, _mm_load_si128((const __m128i*)RGB_SHUFFLE[k][2])));
+			_mm_storeu_si128((__m128i*)(dst + 16 * k), out);
+		}
+	}
+
+	RSW_TARGET("sse2") static inline void storeRgb16Sse2(__m128i r, __m128i g, __m128i b, uint8_t* dst) {
+		alignas(16) uint8_t planes[3][16];
+		_mm_store_si128((__m128i*)planes[0], r);
+		_mm_store_si128((__m128i*)planes[1], g);
+		_mm_store_si128((__m128i*)planes[2], b);
+		for (int i = 0; i < 16; ++i) {
+			dst[3 * i] = planes[0][i];
+			dst[3 * i + 1] = planes[1][i];
+			dst[3 * i + 2] = planes[2][i];
+		}
+	}
+
+	// One channel of 8 pixels, base holds 298 * c + 128 and de the (d, e) pairs, both as
+	// low and high halves. madd keeps the products in 32 bits so rounding matches the scalar code.
+	RSW_TARGET("sse2") static inline __m128i yuvChannel(__m128i baseLo, __m128i baseHi,
+			__m128i deLo, __m128i deHi, __m128i coeffs) {
+		__m128i lo = _mm_srai_epi32(_mm_add_epi32(baseLo, _mm_madd_epi16(deLo, coeffs)), 8);
+		__m128i hi = _mm_srai_epi32(_mm_add_epi32(baseHi, _mm_madd_epi16(deHi, coeffs)), 8);
+		return _mm_packs_epi32(lo, hi);
+	}
+
+	// R, G and B of 8 pixels from 16 bytes of YUYV, as 16 bit values before clamping
+	RSW_TARGET("sse2") static inline void yuyvPlanes8(__m128i v, __m128i& r, __m128i& g, __m128i& b) {
+		__m128i c = _mm_sub_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_set1_epi16(16));
+		// U and V of a pixel pair share a 32 bit lane, copy them to both pixels
+		__m128i uv = _mm_srli_epi16(v, 8);
+		__m128i u = _mm_and_si128(uv, _mm_set1_epi32(0xFFFF));
+		__m128i w = _mm_srli_epi32(uv, 16);
+		__m128i d = _mm_sub_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), _mm_set1_epi16(128));
+		__m128i e = _mm_sub_epi16(_mm_or_si128(w, _mm_slli_epi32(w, 16)), _mm_set1_epi16(128));
+
+		const __m128i base = _mm_set_epi16(128, 298, 128, 298, 128, 298, 128, 298);
+		__m128i one = _mm_set1_epi16(1);
+		__m128i baseLo = _mm_madd_epi16(_mm_unpacklo_epi16(c, one), base);
+		__m128i baseHi = _mm_madd_epi16(_mm_unpackhi_epi16(c, one), base);
+		__m128i deLo = _mm_unpacklo_epi16(d, e);
+		__m128i deHi = _mm_unpackhi_epi16(d, e);
+		r = yuvChannel(baseLo, baseHi, deLo, deHi, _mm_set_epi16(409, 0, 409, 0, 409, 0, 409, 0));
+		g = yuvChannel(baseLo, baseHi, deLo, deHi, _mm_set_epi16(-208, -100, -208, -100, -208, -100, -208, -100));
+		b = yuvChannel(baseLo, baseHi, deLo, deHi, _mm_set_epi16(0, 516, 0, 516, 0, 516, 0, 516));
+	}
+
+	RSW_TARGET("sse2") static void yuyvSse2(const uint8_t* src, uint8_t* dst, size_t pixels, bool bgr) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i r0, g0, b0, r1, g1, b1;
+			yuyvPlanes8(_mm_loadu_si128((const __m128i*)(src + 2 * i)), r0, g0, b0);
+			yuyvPlanes8(_mm_loadu_si128((const __m128i*)(src + 2 * i + 16)), r1, g1, b1);
+			__m128i r = _mm_packus_epi16(r0, r1);
+			__m128i g = _mm_packus_epi16(g0, g1);
+			__m128i b = _mm_packus_epi16(b0, b1);
+			storeRgb16Sse2(bgr ? b : r, g, bgr ? r : b, dst + 3 * i);
+		}
+		yuyvScalar(src + 2 * i, dst + 3 * i, pixels - i, bgr ? 2 : 0, bgr ? 0 : 2);
+	}
+
+	RSW_TARGET("ssse3") static void yuyvSsse3(const uint8_t* src, uint8_t* dst, size_t pixels, bool bgr) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i r0, g0, b0, r1, g1, b1;
+			yuyvPlanes8(_mm_loadu_si128((const __m128i*)(src + 2 * i)), r0, g0, b0);
+			yuyvPlanes8(_mm_loadu_si128((const __m128i*)(src + 2 * i + 16)), r1, g1, b1);
+			__m128i r = _mm_packus_epi16(r0, r1);
+			__m128i g = _mm_packus_epi16(g0, g1);
+			__m128i b = _mm_packus_epi16(b0, b1);
+			storeRgb16(bgr ? b : r, g, bgr ? r : b, dst + 3 * i);
+		}
+		yuyvScalar(src + 2 * i, dst + 3 * i, pixels - i, bgr ? 2 : 0, bgr ? 0 : 2);
+	}
+
+	RSW_TARGET("avx2") static inline __m256i yuvChannelAvx2(__m256i baseLo, __m256i baseHi,
+			__m256i deLo, __m256i deHi, __m256i coeffs) {
+		__m256i lo = _mm256_srai_epi32(_mm256_add_epi32(baseLo, _mm256_madd_epi16(deLo, coeffs)), 8);
+		__m256i hi = _mm256_srai_epi32(_mm256_add_epi32(baseHi, _mm256_madd_epi16(deHi, coeffs)), 8);
+		return _mm256_packs_epi32(lo, hi);
+	}
+
+	// Same as the SSE2 version with 16 pixels per step. Unpacking and packing both stay
+	// within 128 bit lanes, so pixel order is kept.
+	RSW_TARGET("avx2") static void yuyvAvx2(const uint8_t* src, uint8_t* dst, size_t pixels, bool bgr) {
+		const __m256i base = _mm256_set1_epi32((128 << 16) | 298);
+		const __m256i coeffR = _mm256_set1_epi32(409 << 16);
+		const __m256i coeffG = _mm256_set1_epi32((int)(((uint32_t)(-208) << 16) | (uint16_t)-100));
+		const __m256i coeffB = _mm256_set1_epi32(516);
+		const __m256i one = _mm256_set1_epi16(1);
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+			__m256i c = _mm256_sub_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), _mm256_set1_epi16(16));
+			__m256i uv = _mm256_srli_epi16(v, 8);
+			__m256i u = _mm256_and_si256(uv, _mm256_set1_epi32(0xFFFF));
+			__m256i w = _mm256_srli_epi32(uv, 16);
+			__m256i d = _mm256_sub_epi16(_mm256_or_si256(u, _mm256_slli_epi32(u, 16)), _mm256_set1_epi16(128));
+			__m256i e = _mm256_sub_epi16(_mm256_or_si256(w, _mm256_slli_epi32(w, 16)), _mm256_set1_epi16(128));
+
+			__m256i baseLo = _mm256_madd_epi16(_mm256_unpacklo_epi16(c, one), base);
+			__m256i baseHi = _mm256_madd_epi16(_mm256_unpackhi_epi16(c, one), base);
+			__m256i deLo = _mm256_unpacklo_epi16(d, e);
+			__m256i deHi = _mm256_unpackhi_epi16(d, e);
+			__m256i r = yuvChannelAvx2(baseLo, baseHi, deLo, deHi, coeffR);
+			__m256i g = yuvChannelAvx2(baseLo, baseHi, deLo, deHi, coeffG);
+			__m256i b = yuvChannelAvx2(baseLo, baseHi, deLo, deHi, coeffB);
+
+			// packing works per lane, put the two halves of each channel next to each other
+			__m256i rg = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, g), 0xD8);
+			__m256i bb = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, b), 0xD8);
+			__m128i r8 = _mm256_castsi256_si128(rg);
+			__m128i g8 = _mm256_extracti128_si256(rg, 1);
+			__m128i b8 = _mm256_castsi256_si128(bb);
+			storeRgb16(bgr ? b8 : r8, g8, bgr ? r8 : b8, dst + 3 * i);
+		}
+		yuyvScalar(src + 2 * i, dst + 3 * i, pixels - i, bgr ? 2 : 0, bgr ? 0 : 2);
+	}
+
+	RSW_TARGET("ssse3") static void swapRedBlueSsse3(const uint8_t* src, uint8_t* dst, size_t pixels) {
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		size_t bytes = pixels * 3;
+		size_t i = 0;
+		// 5 pixels per step, the 16th byte is stored unchanged and redone by the next step
+		for (; i + 16 <= bytes; i += 15) {
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle));
+		}
+		swapRedBlueScalar(src + i, dst + i, (bytes - i) / 3);
+	}
+
+	RSW_TARGET("ssse3") static void unpackRaw10Ssse3(const uint8_t* src, uint16_t* dst, size_t pixels) {
+		// every 16 bit lane gets a pixel's high byte on top of its group's byte of low bits
+		const __m128i shuffle = _mm_setr_epi8(4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8);
+		// moves the pixel's 2 low bits to bits 6 and 7
+		const __m128i shifts = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+		const __m128i high = _mm_set1_epi16((short)0xFF00);
+		const __m128i low = _mm_set1_epi16(0x00C0);
+		size_t bytes = pixels / 4 * 5;
+		size_t i = 0;
+		// 8 pixels from 10 bytes per step, loading 16
+		for (; i + 8 <= pixels && i / 4 * 5 + 16 <= bytes; i += 8) {
+			__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i / 4 * 5)), shuffle);
+			__m128i bits = _mm_and_si128(_mm_mullo_epi16(_mm_andnot_si128(high, v), shifts), low);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(v, high), bits));
+		}
+		unpackRaw10Scalar(src + i / 4 * 5, dst + i, pixels - i);
+	}
+
+	RSW_TARGET("sse2") static void y16ToY8Sse2(const uint16_t* src, uint8_t* dst, size_t pixels) {
+		size_t i = 0;
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(src + i)), 8);
+			__m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(src + i + 8)), 8);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+		}
+		y16ToY8Scalar(src + i, dst + i, pixels - i);
+	}
+
+	RSW_TARGET("avx2") static void y16ToY8Avx2(const uint16_t* src, uint8_t* dst, size_t pixels) {
+		size_t i = 0;
+		for (; i + 32 <= pixels; i += 32) {
+			__m256i a = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(src + i)), 8);
+			__m256i b = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(src + i + 16)), 8);
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+		}
+		y16ToY8Sse2(src + i, dst + i, pixels - i);
+	}
+#endif
+
+	static void yuyvConvert(const uint8_t* src, uint8_t* dst, size_t pixels, bool bgr) {
+		switch (getSimdLevel()) {
+#ifdef RSW_X86
+		case SIMD_AVX2: yuyvAvx2(src, dst, pixels, bgr); return;
+		case SIMD_SSSE3: yuyvSsse3(src, dst, pixels, bgr); return;
+		case SIMD_SSE2: yuyvSse2(src, dst, pixels, bgr); return;
+#endif
+		default: yuyvScalar(src, dst, pixels, bgr ? 2 : 0, bgr ? 0 : 2); return;
+		}
+	}
+
+	void yuyvToRgb(const uint8_t* src, uint8_t* dst, size_t pixels) {
+		yuyvConvert(src, dst, pixels, false);
+	}
+
+	void yuyvToBgr(const uint8_t* src, uint8_t* dst, size_t pixels) {
+		yuyvConvert(src, dst, pixels, true);
+	}
+
+	void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels) {
+#ifdef RSW_X86
+		if (getSimdLevel() >= SIMD_SSSE3) {
+			swapRedBlueSsse3(src, dst, pixels);
+			return;
+		}
+#endif
+		swapRedBlueScalar(src, dst, pixels);
+	}
+
+	void unpackRaw10(const uint8_t* src, uint16_t* dst, size_t pixels) {
+#ifdef RSW_X86
+		if (getSimdLevel() >= SIMD_SSSE3) {
+			unpackRaw10Ssse3(src, dst, pixels);
+			return;
+		}
+#endif
+		unpackRaw10Scalar(src, dst, pixels);
+	}
+
+	void y16ToY8(const uint16_t* src, uint8_t* dst, size_t pixels) {
+		switch (getSimdLevel()) {
+#ifdef RSW_X86
+		case SIMD_AVX2: y16ToY8Avx2(src, dst, pixels); return;
+		case SIMD_SSSE3:
+		case SIMD_SSE2: y16ToY8Sse2(src, dst, pixels); return;
+#endif
+		default: y16ToY8Scalar(src, dst, pixels); return;
+		}
+	}
+
+	// One channel of the jet color map, t from 0 (blue) to 1 (red)
+	static uint8_t jetChannel(double t, double center) {
+		double v = std::min(std::max(1.5 - std::abs(4.0 * t - center), 0.0), 1.0);
+		return (uint8_t)(v * 255.0 + 0.5);
+	}
+
+	DepthColorizer::DepthColorizer(Mode mode, uint16_t minDepth, uint16_t maxDepth) :
+								   _mode(mode), _lut(0x10000, 0), _histogram(mode == HISTOGRAM ? 0x10000 : 0) {
+		for (int i = 0; i < 256; ++i) {
+			double t = 1.0 - i / 255.0;
+			_palette[i][0] = jetChannel(t, 3.0);
+			_palette[i][1] = jetChannel(t, 2.0);
+			_palette[i][2] = jetChannel(t, 1.0);
+		}
+		if (mode == LINEAR) {
+			int range = std::max((int)maxDepth - (int)minDepth, 1);
+			for (int d = 0; d < 0x10000; ++d) {
+				int clamped = std::min(std::max(d, (int)minDepth), (int)maxDepth);
+				_lut[d] = (uint8_t)((clamped - minDepth) * 255 / range);
+			}
+		}
+	}
+
+	void DepthColorizer::colorize(const uint16_t* depth, uint8_t* rgb, size_t pixels) {
+		if (_mode == HISTOGRAM) {
+			std::fill(_histogram.begin(), _histogram.end(), 0);
+			for (size_t i = 0; i < pixels; ++i) {
+				++_histogram[depth[i]];
+			}
+			// a depth's color is the share of pixels at or nearer than it, pixels without depth
+			// do not count. The share is scaled to 32 bit fixed point to avoid a division per depth.
+			uint64_t total = pixels - _histogram[0];
+			uint64_t scale = total == 0 ? 0 : (255ull << 32) / total;
+			uint64_t sum = 0;
+			for (size_t d = 1; d < 0x10000; ++d) {
+				sum += _histogram[d];
+				_lut[d] = (uint8_t)((sum * scale) >> 32);
+			}
+		}
+
+		for (size_t i = 0; i < pixels; ++i) {
+			uint16_t d = depth[i];
+			if (d == 0) {
+				rgb[0] = rgb[1] = rgb[2] = 0;
+			} else {
+				const uint8_t* color = _palette[_lut[d]];
+				rgb[0] = color[0];
+				rgb[1] = color[1];
+				rgb[2] = color[2];
+			}
+			rgb += 3;
+		}
+	}
+
+	bool canConvert(rs::format from, rs::format to) {
+		if (from == to) {
+			return from != rs::format::any;
+		}
+		switch (from) {
+		case rs::format::yuyv: return to == rs::format::rgb8 || to == rs::format::bgr8;
+		case rs::format::rgb8: return to == rs::format::bgr8;
+		case rs::format::bgr8: return to == rs::format::rgb8;
+		case rs::format::raw10: return to == rs::format::y16 || to == rs::format::y8;
+		case rs::format::y16: return to == rs::format::y8;
+		case rs::format::z16: return to == rs::format::rgb8 || to == rs::format::bgr8;
+		default: return false;
+		}
+	}
+
+	bool convertFrame(const FrameHandle& in, rs::format fmt, FrameHandle& out) {
+		if (in.empty() || in.width() <= 0 || in.height() <= 0 || !canConvert(in.format(), fmt)) {
+			return false;
+		}
+		if (in.format() == fmt) {
+			out = in;
+			return true;
+		}
+		size_t pixels = (size_t)in.width() * in.height();
+		if (in.size() < (size_t)getImgSize(in.width(), in.height(), (rs_format)in.format())) {
+			return false;
+		}
+
+		auto buffer = std::make_shared<std::vector<char>>(getImgSize(in.width(), in.height(), (rs_format)fmt));
+		const uint8_t* src = reinterpret_cast<const uint8_t*>(in.data());
+		uint8_t* dst = reinterpret_cast<uint8_t*>(buffer->data());
+		switch (in.format()) {
+		case rs::format::yuyv:
+			if (fmt == rs::format::rgb8) {
+				yuyvToRgb(src, dst, pixels);
+			} else {
+				yuyvToBgr(src, dst, pixels);
+			}
+			break;
+		case rs::format::rgb8:
+		case rs::format::bgr8:
+			swapRedBlue(src, dst, pixels);
+			break;
+		case rs::format::raw10:
+			if (fmt == rs::format::y16) {
+				unpackRaw10(src, reinterpret_cast<uint16_t*>(dst), pixels);
+			} else {
+				std::vector<uint16_t> y16(pixels);
+				unpackRaw10(src, y16.data(), pixels);
+				y16ToY8(y16.data(), dst, pixels);
+			}
+			break;
+		case rs::format::y16:
+			y16ToY8(reinterpret_cast<const uint16_t*>(src), dst, pixels);
+			break;
+		case rs::format::z16: {
+			// one per thread, the histogram is too large to set up for every frame
+			static thread_local DepthColorizer colorizer;
+			colorizer.colorize(reinterpret_cast<const uint16_t*>(src), dst, pixels);
+			if (fmt == rs::format::bgr8) {
+				swapRedBlue(dst, dst, pixels);
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+
+		out = FrameHandle(buffer, buffer->data(), buffer->size(), in.width(), in.height(), fmt, in.timestamp());
+		return true;
+	}
+}
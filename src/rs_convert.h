@@ -0,0 +1,75 @@
+#ifndef RSCONVERT_H
+#define RSCONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <rs.hpp>
+
+#include "rs_frame_handle.h"
+
+namespace rsw {
+	/// Instruction sets the conversion kernels can use. The best one the CPU supports is
+	/// picked at runtime, every kernel gives the same result as its scalar version.
+	enum SimdLevel {
+		SIMD_SCALAR = 0,
+		SIMD_SSE2,
+		SIMD_SSSE3,
+		SIMD_AVX2
+	};
+
+	/// Returns the level the kernels currently use
+	SimdLevel getSimdLevel();
+	/// Returns the best level the CPU supports
+	SimdLevel getSupportedSimdLevel();
+	/// Limits the kernels to level, or to what the CPU supports if that is lower.
+	/// Returns the level now in use. For benchmarks and comparing against the scalar code.
+	SimdLevel setSimdLevel(SimdLevel level);
+	const char* getSimdLevelName(SimdLevel level);
+
+	/// YUYV (4:2:2) to packed RGB8 or BGR8, pixels must be even. BT.601 studio range,
+	/// same coefficients as librealsense.
+	void yuyvToRgb(const uint8_t* src, uint8_t* dst, size_t pixels);
+	void yuyvToBgr(const uint8_t* src, uint8_t* dst, size_t pixels);
+	/// Swaps the first and third channel of packed 3 byte pixels, BGR8 to RGB8 and back.
+	/// src and dst may be the same buffer.
+	void swapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels);
+	/// Unpacks RAW10 (4 pixels in 5 bytes, MIPI layout) to Y16 with the 10 bits in the high
+	/// bits, pixels must be a multiple of 4
+	void unpackRaw10(const uint8_t* src, uint16_t* dst, size_t pixels);
+	/// Keeps the high byte of each Y16 pixel
+	void y16ToY8(const uint16_t* src, uint8_t* dst, size_t pixels);
+
+	/// Maps Z16 depth to RGB8 colors from red (near) to blue (far), pixels without depth are black
+	class DepthColorizer {
+	public:
+		enum Mode {
+			HISTOGRAM = 0, // equalized over the depths of each frame, spreads colors over the scene
+			LINEAR         // fixed ramp from minDepth to maxDepth, colors mean the same in every frame
+		};
+
+		DepthColorizer(Mode mode = HISTOGRAM, uint16_t minDepth = 1, uint16_t maxDepth = 0xFFFF);
+
+		void colorize(const uint16_t* depth, uint8_t* rgb, size_t pixels);
+
+	private:
+		Mode _mode;
+		// palette entry of every depth value
+		std::vector<uint8_t> _lut;
+		// counts of each depth value in the frame being colorized, HISTOGRAM only
+		std::vector<uint32_t> _histogram;
+		uint8_t _palette[256][3];
+	};
+
+	/// Returns true if convertFrame can turn frames of format from into format to
+	bool canConvert(rs::format from, rs::format to);
+
+	/// Converts a frame to fmt into a new buffer owned by out. Supported are YUYV to RGB8/BGR8,
+	/// RGB8 and BGR8 into each other, RAW10 to Y16/Y8, Y16 to Y8, and Z16 to RGB8/BGR8 colorized
+	/// by the frame's depth histogram. A frame already in fmt is passed on without a copy.
+	/// Returns false if the conversion is not supported or the frame is too small.
+	bool convertFrame(const FrameHandle& in, rs::format fmt, FrameHandle& out);
+}
+
+#endif
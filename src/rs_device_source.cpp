@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "rs_device_source.h"
+#include "rs_frame_handle.h"
+#include "rs_recording.h"
+
+namespace rsw {
+	RealSenseSource::RealSenseSource(rs::device* dev) : _dev(dev) {
+	}
+
+	std::string RealSenseSource::getSerial() {
+		return _dev->get_serial();
+	}
+
+	std::string RealSenseSource::getName() {
+		return _dev->get_name();
+	}
+
+	void RealSenseSource::enableStream(rs::stream strm, int width, int height, rs::format fmt, int framerate) {
+		_dev->enable_stream(strm, width, height, fmt, framerate);
+	}
+
+	void RealSenseSource::disableStream(rs::stream strm) {
+		_dev->disable_stream(strm);
+	}
+
+	bool RealSenseSource::isStreamEnabled(rs::stream strm) {
+		return _dev->is_stream_enabled(strm);
+	}
+
+	void RealSenseSource::start() {
+		_dev->start();
+	}
+
+	void RealSenseSource::stop() {
+		_dev->stop();
+	}
+
+	bool RealSenseSource::isStreaming() {
+		return _dev->is_streaming();
+	}
+
+	void RealSenseSource::waitForFrames() {
+		_dev->wait_for_frames();
+	}
+
+	int RealSenseSource::getFrameTimestamp(rs::stream strm) {
+		return _dev->get_frame_timestamp(strm);
+	}
+
+	const void* RealSenseSource::getFrameData(rs::stream strm) {
+		return _dev->get_frame_data(strm);
+	}
+
+	rs::intrinsics RealSenseSource::getStreamIntrinsics(rs::stream strm) {
+		return _dev->get_stream_intrinsics(strm);
+	}
+
+	rs::extrinsics RealSenseSource::getExtrinsics(rs::stream from, rs::stream to) {
+		return _dev->get_extrinsics(from, to);
+	}
+
+	float RealSenseSource::getDepthScale() {
+		return _dev->get_depth_scale();
+	}
+
+	// A wide depth camera whose images need inverse Brown-Conrady undistortion, and a narrower
+	// color camera with forward distortion, as on an R200
+	static rs::intrinsics simulatedIntrinsics(rs::stream strm, int width, int height) {
+		static const float depthCoeffs[5] = { 0.04f, -0.03f, 0.0005f, 0.0007f, 0.0f };
+		static const float colorCoeffs[5] = { -0.05f, 0.06f, 0.0008f, -0.0005f, 0.0f };
+		bool color = strm == rs::stream::color;
+		rs::intrinsics in;
+		in.width = width;
+		in.height = height;
+		in.fx = width * (color ? 1.1f : 0.85f);
+		in.fy = in.fx;
+		in.ppx = width / 2.0f + 1.5f;
+		in.ppy = height / 2.0f - 2.0f;
+		in.rs_intrinsics::model = color ? RS_DISTORTION_MODIFIED_BROWN_CONRADY : RS_DISTORTION_INVERSE_BROWN_CONRADY;
+		std::memcpy(in.coeffs, color ? colorCoeffs : depthCoeffs, sizeof(in.coeffs));
+		return in;
+	}
+
+	// Offset of each camera from the depth camera along x, meters
+	static float simulatedPosition(rs::stream strm) {
+		switch (strm) {
+		case rs::stream::color: return 0.025f;
+		case rs::stream::infrared2: return 0.07f;
+		default: return 0.0f;
+		}
+	}
+
+	SimulatedSource::SimulatedSource(std::string serial) : SimulatedSource(serial, Config()) {
+	}
+
+	SimulatedSource::SimulatedSource(std::string serial, Config config) :
+									 _serial(serial), _config(config), _streams(), _streaming(false),
+									 _start(), _rng(config.seed), _delivered(0), _dropped(0) {
+	}
+
+	std::string SimulatedSource::getSerial() {
+		return _serial;
+	}
+
+	std::string SimulatedSource::getName() {
+		return _config.name;
+	}
+
+	void SimulatedSource::enableStream(rs::stream strm, int width, int height, rs::format fmt, int framerate) {
+		if (_streaming) {
+			throw std::runtime_error("Unable to enable " + std::string(rs_stream_to_string((rs_stream)strm)) +
+				" while streaming");
+		}
+		if (width <= 0 || height <= 0 || framerate <= 0 || fmt == rs::format::any) {
+			throw std::runtime_error("Unsupported mode for " + std::string(rs_stream_to_string((rs_stream)strm)));
+		}
+
+		Stream s = { width, height, fmt, framerate, std::vector<std::vector<char>>(), 0, 0.0, -1, nullptr,
+			simulatedIntrinsics(strm, width, height) };
+		auto replay = _config.replay.find(strm);
+		if (replay == _config.replay.end() || !replayFrames(s, replay->second)) {
+			generateFrames(s, strm);
+		}
+		_streams[strm] = s;
+	}
+
+	void SimulatedSource::disableStream(rs::stream strm) {
+		if (_streaming) {
+			throw std::runtime_error("Unable to disable " + std::string(rs_stream_to_string((rs_stream)strm)) +
+				" while streaming");
+		}
+		_streams.erase(strm);
+	}
+
+	bool SimulatedSource::isStreamEnabled(rs::stream strm) {
+		return _streams.count(strm) != 0;
+	}
+
+	void SimulatedSource::start() {
+		if (_streams.empty()) {
+			throw std::runtime_error("No streams enabled on " + _serial);
+		}
+		for (auto& s : _streams) {
+			s.second.due = 0.0;
+			s.second.timestamp = -1;
+			s.second.data = nullptr;
+		}
+		_start = std::chrono::steady_clock::now();
+		_streaming = true;
+	}
+
+	void SimulatedSource::stop() {
+		_streaming = false;
+	}
+
+	bool SimulatedSource::isStreaming() {
+		return _streaming;
+	}
+
+	void SimulatedSource::waitForFrames() {
+		if (!_streaming) {
+			throw std::runtime_error("Device " + _serial + " is not streaming");
+		}
+		std::normal_distribution<double> jitter(0.0, _config.jitter);
+		std::uniform_real_distribution<double> drop(0.0, 1.0);
+
+		while (true) {
+			// streams with the same framerate are due together and arrive as one frameset
+			double due = -1.0;
+			for (auto& s : _streams) {
+				if (due < 0.0 || s.second.due < due) {
+					due = s.second.due;
+				}
+			}
+			double arrival = due + (_config.jitter > 0.0 ? std::abs(jitter(_rng)) : 0.0);
+			std::this_thread::sleep_until(_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double, std::milli>(arrival)));
+
+			bool delivered = false;
+			for (auto& entry : _streams) {
+				Stream& s = entry.second;
+				if (s.due > due + 1e-6) {
+					continue;
+				}
+				if (_config.dropRate > 0.0 && drop(_rng) < _config.dropRate) {
+					++_dropped;
+				} else {
+					s.timestamp = (int)(s.due * (1.0 + _config.clockSkew)) + _config.clockOffset;
+					s.data = s.frames[s.next++ % s.frames.size()].data();
+					delivered = true;
+					++_delivered;
+				}
+				s.due += 1000.0 / s.framerate;
+			}
+			if (delivered) {
+				return;
+			}
+		}
+	}
+
+	int SimulatedSource::getFrameTimestamp(rs::stream strm) {
+		auto s = _streams.find(strm);
+		if (s == _streams.end()) {
+			throw std::runtime_error(std::string(rs_stream_to_string((rs_stream)strm)) + " is not enabled");
+		}
+		return s->second.timestamp;
+	}
+
+	const void* SimulatedSource::getFrameData(rs::stream strm) {
+		auto s = _streams.find(strm);
+		if (s == _streams.end()) {
+			throw std::runtime_error(std::string(rs_stream_to_string((rs_stream)strm)) + " is not enabled");
+		}
+		return s->second.data;
+	}
+
+	rs::intrinsics SimulatedSource::getStreamIntrinsics(rs::stream strm) {
+		auto s = _streams.find(strm);
+		if (s == _streams.end()) {
+			throw std::runtime_error(std::string(rs_stream_to_string((rs_stream)strm)) + " is not enabled");
+		}
+		return s->second.intrinsics;
+	}
+
+	rs::extrinsics SimulatedSource::getExtrinsics(rs::stream from, rs::stream to) {
+		// all cameras look the same way
+		rs::extrinsics e;
+		for (int i = 0; i < 9; ++i) {
+			e.rotation[i] = i % 4 == 0 ? 1.0f : 0.0f;
+		}
+		e.translation[0] = simulatedPosition(from) - simulatedPosition(to);
+		e.translation[1] = 0.0f;
+		e.translation[2] = 0.0f;
+		return e;
+	}
+
+	float SimulatedSource::getDepthScale() {
+		return 0.001f;
+	}
+
+	void SimulatedSource::generateFrames(Stream& s, rs::stream strm) {
+		int size = getImgSize(s.width, s.height, (rs_format)s.format);
+		int rowBytes = getImgSize(s.width, 1, (rs_format)s.format);
+
+		s.frames.resize(std::max<size_t>(_config.frameCount, 1));
+		for (size_t i = 0; i < s.frames.size(); ++i) {
+			std::vector<char>& frame = s.frames[i];
+			frame.resize(size);
+			if (s.format == rs::format::z16 || s.format == rs::format::disparity16 || s.format == rs::format::y16) {
+				// a slanted floor with a box moving across it, some noise and invalid pixels
+				uint16_t* px = reinterpret_cast<uint16_t*>(frame.data());
+				int boxX = (int)(i * s.width / s.frames.size());
+				for (int y = 0; y < s.height; ++y) {
+					for (int x = 0; x < s.width; ++x) {
+						int depth = 3000 - y * 2000 / s.height;
+						if (x >= boxX && x < boxX + s.width / 4 && y > s.height / 3 && y < s.height * 2 / 3) {
+							depth = 900;
+						}
+						// one draw gives a hole in 1 of 200 pixels and noise of -3 to 3 around the depth,
+						// distributions would make enabling a stream take seconds
+						uint32_t r = _rng();
+						depth += (int)((r >> 8) & 3) + (int)((r >> 10) & 3) - 3;
+						px[y * s.width + x] = r % 200 == 0 ? 0 : (uint16_t)depth;
+					}
+				}
+			} else {
+				// gradients, shifted every frame
+				for (int y = 0; y < s.height; ++y) {
+					for (int b = 0; b < rowBytes; ++b) {
+						frame[y * rowBytes + b] = (char)(b * 255 / rowBytes + y + (int)i * 4 + (int)strm * 64);
+					}
+				}
+			}
+		}
+	}
+
+	bool SimulatedSource::replayFrames(Stream& s, const fs::path& dir) {
+		size_t size = getImgSize(s.width, s.height, (rs_format)s.format);
+		RecordingReader reader(dir);
+		std::vector<char> frame;
+		for (auto& e : reader.getIndex()) {
+			if (s.frames.size() >= _config.frameCount) {
+				break;
+			}
+			if (reader.read(e.timestamp, frame) && frame.size() == size) {
+				s.frames.push_back(frame);
+			}
+		}
+
+		StreamCalibration calibration;
+		if (!s.frames.empty() && readCalibration(dir, calibration) &&
+				calibration.intrinsics.width == s.width && calibration.intrinsics.height == s.height) {
+			static_cast<rs_intrinsics&>(s.intrinsics) = calibration.intrinsics;
+		}
+		return !s.frames.empty();
+	}
+}
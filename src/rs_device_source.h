@@ -0,0 +1,147 @@
+#ifndef RSDEVICESOURCE_H
+#define RSDEVICESOURCE_H
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <string>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+#include <boost/filesystem.hpp>
+#include <rs.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	/// The part of rs::device that capturing needs, so the capture path runs the same way
+	/// against a camera or a simulated device. Calls come from one thread at a time.
+	class DeviceSource {
+	public:
+		virtual ~DeviceSource() {}
+
+		virtual std::string getSerial() = 0;
+		virtual std::string getName() = 0;
+
+		virtual void enableStream(rs::stream strm, int width, int height, rs::format fmt, int framerate) = 0;
+		virtual void disableStream(rs::stream strm) = 0;
+		virtual bool isStreamEnabled(rs::stream strm) = 0;
+
+		virtual void start() = 0;
+		virtual void stop() = 0;
+		virtual bool isStreaming() = 0;
+
+		/// Blocks until at least one enabled stream has a new frame
+		virtual void waitForFrames() = 0;
+		/// Timestamp and data of the latest frame of a stream, data stays valid until the
+		/// next waitForFrames
+		virtual int getFrameTimestamp(rs::stream strm) = 0;
+		virtual const void* getFrameData(rs::stream strm) = 0;
+
+		/// Calibration, intrinsics only of enabled streams
+		virtual rs::intrinsics getStreamIntrinsics(rs::stream strm) = 0;
+		virtual rs::extrinsics getExtrinsics(rs::stream from, rs::stream to) = 0;
+		/// Meters per unit of Z16 depth
+		virtual float getDepthScale() = 0;
+	};
+
+	/// A connected camera, errors are thrown as rs::error
+	class RealSenseSource : public DeviceSource {
+	public:
+		RealSenseSource(rs::device* dev);
+
+		std::string getSerial();
+		std::string getName();
+		void enableStream(rs::stream strm, int width, int height, rs::format fmt, int framerate);
+		void disableStream(rs::stream strm);
+		bool isStreamEnabled(rs::stream strm);
+		void start();
+		void stop();
+		bool isStreaming();
+		void waitForFrames();
+		int getFrameTimestamp(rs::stream strm);
+		const void* getFrameData(rs::stream strm);
+		rs::intrinsics getStreamIntrinsics(rs::stream strm);
+		rs::extrinsics getExtrinsics(rs::stream from, rs::stream to);
+		float getDepthScale();
+
+	private:
+		rs::device* _dev;
+	};
+
+	/// Generates frames for any stream and mode on a timer, or replays them from recordings.
+	/// Streams get a made up calibration close to an R200's, replayed ones the calibration
+	/// stored with the recording. Errors are thrown as std::runtime_error.
+	class SimulatedSource : public DeviceSource {
+	public:
+		struct Config {
+			std::string name = "Simulated RealSense";
+			// standard deviation of the delay between a frame's timestamp and its arrival, ms
+			double jitter = 0.0;
+			// fraction of frames that never arrive
+			double dropRate = 0.0;
+			// added to every timestamp, devices do not share a clock
+			int clockOffset = 0;
+			// how much faster the device clock runs than the host clock, 1e-4 is 100 ppm
+			double clockSkew = 0.0;
+			// streams whose frames are taken from a recording folder instead of generated,
+			// frames of another size than the enabled mode are skipped
+			std::map<rs::stream, fs::path> replay;
+			// generated or replayed frames are cycled, at most this many are kept per stream
+			size_t frameCount = 30;
+			unsigned seed = 1;
+		};
+
+		SimulatedSource(std::string serial);
+		SimulatedSource(std::string serial, Config config);
+
+		std::string getSerial();
+		std::string getName();
+		void enableStream(rs::stream strm, int width, int height, rs::format fmt, int framerate);
+		void disableStream(rs::stream strm);
+		bool isStreamEnabled(rs::stream strm);
+		void start();
+		void stop();
+		bool isStreaming();
+		void waitForFrames();
+		int getFrameTimestamp(rs::stream strm);
+		const void* getFrameData(rs::stream strm);
+		rs::intrinsics getStreamIntrinsics(rs::stream strm);
+		rs::extrinsics getExtrinsics(rs::stream from, rs::stream to);
+		float getDepthScale();
+
+		/// Frames delivered so far, and frames skipped to simulate drops
+		uint64_t getFrameCount() const { return _delivered; }
+		uint64_t getDropCount() const { return _dropped; }
+
+	private:
+		struct Stream {
+			int width;
+			int height;
+			rs::format format;
+			int framerate;
+			std::vector<std::vector<char>> frames;
+			size_t next;
+			// host time since start() that the next frame is captured at, ms
+			double due;
+			int timestamp;
+			const void* data;
+			rs::intrinsics intrinsics;
+		};
+
+		std::string _serial;
+		Config _config;
+		std::map<rs::stream, Stream> _streams;
+		bool _streaming;
+		std::chrono::steady_clock::time_point _start;
+		std::mt19937 _rng;
+		std::atomic<uint64_t> _delivered;
+		std::atomic<uint64_t> _dropped;
+
+		void generateFrames(Stream& s, rs::stream strm);
+		bool replayFrames(Stream& s, const fs::path& dir);
+	};
+}
+
+#endif
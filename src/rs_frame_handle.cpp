@@ -0,0 +1,41 @@
+#include <cassert>
+
+#include "rs_frame_handle.h"
+
+namespace rsw {
+	// Copied from librealsense/src/image.cpp
+	int getImgSize(int width, int height, rs_format format) {
+		switch (format)
+		{
+		case RS_FORMAT_Z16: return width * height * 2;
+		case RS_FORMAT_DISPARITY16: return width * height * 2;
+		case RS_FORMAT_XYZ32F: return width * height * 12;
+		case RS_FORMAT_YUYV: assert(width % 2 == 0); return width * height * 2;
+		case RS_FORMAT_RGB8: return width * height * 3;
+		case RS_FORMAT_BGR8: return width * height * 3;
+		case RS_FORMAT_RGBA8: return width * height * 4;
+		case RS_FORMAT_BGRA8: return width * height * 4;
+		case RS_FORMAT_Y8: return width * height;
+		case RS_FORMAT_Y16: return width * height * 2;
+		case RS_FORMAT_RAW10: assert(width % 4 == 0); return width * 5 / 4 * height;
+		default: assert(false); return 0;
+		}
+	}
+
+	FrameHandle::FrameHandle() : _owner(), _data(nullptr), _size(0), _width(0), _height(0),
+								 _format(rs::format::any), _stride(0), _timestamp(-1) {
+	}
+
+	FrameHandle::FrameHandle(std::shared_ptr<const void> owner, const char* data, size_t size,
+							 int width, int height, rs::format fmt, int timestamp) :
+							 _owner(owner), _data(data), _size(size), _width(width), _height(height),
+							 _format(fmt), _stride(0), _timestamp(timestamp) {
+		if (fmt != rs::format::any && width > 0) {
+			_stride = getImgSize(width, 1, (rs_format)fmt);
+		}
+	}
+
+	void FrameHandle::reset() {
+		*this = FrameHandle();
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef RSFRAMEHANDLE_H
+#define RSFRAMEHANDLE_H
+
+#include <cstddef>
+#include <memory>
+
+#include <rs.hpp>
+
+namespace rsw {
+	/// Returns the number of bytes of an image of the given size and format
+	int getImgSize(int width, int height, rs_format format);
+
+	/// Reference counted, read-only view of one frame. The pixels are not copied, the handle
+	/// keeps whatever owns them (a ring buffer frame or a mapped segment) alive until the last
+	/// copy of the handle is dropped.
+	class FrameHandle {
+	public:
+		FrameHandle();
+		FrameHandle(std::shared_ptr<const void> owner, const char* data, size_t size,
+			int width, int height, rs::format fmt, int timestamp);
+
+		bool empty() const { return _data == nullptr; }
+		const char* data() const { return _data; }
+		size_t size() const { return _size; }
+		int width() const { return _width; }
+		int height() const { return _height; }
+		rs::format format() const { return _format; }
+		/// Bytes per row, 0 if the format is unknown
+		int stride() const { return _stride; }
+		int timestamp() const { return _timestamp; }
+
+		/// Drops this handle's reference to the frame
+		void reset();
+
+	private:
+		std::shared_ptr<const void> _owner;
+		const char* _data;
+		size_t _size;
+		int _width;
+		int _height;
+		rs::format _format;
+		int _stride;
+		int _timestamp;
+	};
+}
+
+#endif
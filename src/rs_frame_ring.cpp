@@ -0,0 +1,39 @@
+#include <algorithm>
+
+#include "rs_frame_ring.h"
+
+namespace rsw {
+	FrameRing::FrameRing(size_t capacity) : _frames(capacity), _pushed(0) {
+	}
+
+	void FrameRing::push(std::shared_ptr<Frame> frame) {
+		if (_frames.empty()) {
+			return;
+		}
+		uint64_t pushed = _pushed.load(std::memory_order_relaxed);
+		// the replaced frame is released here, after the slot already holds the new one
+		std::shared_ptr<Frame> old = std::atomic_exchange(&_frames[pushed % _frames.size()], std::move(frame));
+		_pushed.store(pushed + 1, std::memory_order_release);
+	}
+
+	std::shared_ptr<Frame> FrameRing::latest() {
+		uint64_t pushed = _pushed.load(std::memory_order_acquire);
+		if (pushed == 0 || _frames.empty()) {
+			return nullptr;
+		}
+		return std::atomic_load(&_frames[(pushed - 1) % _frames.size()]);
+	}
+
+	std::shared_ptr<Frame> FrameRing::find(int timestamp) {
+		uint64_t pushed = _pushed.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(pushed, _frames.size());
+		// walk back from the newest frame, recent timestamps are the common case
+		for (uint64_t i = 1; i <= count; ++i) {
+			auto frame = std::atomic_load(&_frames[(pushed - i) % _frames.size()]);
+			if (frame && frame->timestamp == timestamp) {
+				return frame;
+			}
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef RSFRAMERING_H
+#define RSFRAMERING_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "rs_writer.h"
+
+namespace rsw {
+	const size_t DEFAULT_RING_CAPACITY = 30;
+
+	/// Fixed capacity ring of the most recent frames of one stream. The ring shares the
+	/// pooled frames handed to the disk writer, so filling it never copies image data.
+	/// Slots are swapped atomically, readers never hold a lock the capture thread waits on.
+	/// Only one thread may push.
+	class FrameRing {
+	public:
+		/// A ring of capacity 0 is disabled, it keeps nothing and every lookup fails
+		FrameRing(size_t capacity);
+
+		/// Replaces the oldest frame once the ring is full
+		void push(std::shared_ptr<Frame> frame);
+
+		/// Returns nullptr if the ring is empty
+		std::shared_ptr<Frame> latest();
+		/// Returns nullptr if the frame is not, or no longer, in the ring
+		std::shared_ptr<Frame> find(int timestamp);
+
+	private:
+		std::vector<std::shared_ptr<Frame>> _frames;
+		// number of frames pushed so far, the next slot is _pushed % capacity
+		std::atomic<uint64_t> _pushed;
+	};
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <cmath>
+
+#include "rs_histogram.h"
+
+namespace rsw {
+	Histogram::Histogram() : _count(0), _sum(0), _max(0) {
+		for (auto& b : _buckets) {
+			b = 0;
+		}
+	}
+
+	size_t Histogram::bucketFor(uint64_t value) {
+		if (value < 16) {
+			return (size_t)value;
+		}
+		int exponent = 63;
+		while (!(value >> exponent)) {
+			--exponent;
+		}
+		// the 4 bits below the leading one select the bucket within the power of two
+		size_t sub = (size_t)(value >> (exponent - 4)) & 15;
+		return 16 + (exponent - 4) * 16 + sub;
+	}
+
+	uint64_t Histogram::bucketLimit(size_t b) {
+		if (b < 16) {
+			return b;
+		}
+		int shift = (int)(b - 16) / 16;
+		uint64_t sub = (b - 16) % 16;
+		return ((16 + sub) << shift) + ((1ull << shift) - 1);
+	}
+
+	void Histogram::record(uint64_t value) {
+		_buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+		_sum.fetch_add(value, std::memory_order_relaxed);
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	void Histogram::add(const Histogram& other) {
+		for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+			uint64_t n = other._buckets[b].load(std::memory_order_relaxed);
+			if (n != 0) {
+				_buckets[b].fetch_add(n, std::memory_order_relaxed);
+			}
+		}
+		_count.fetch_add(other._count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		_sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		uint64_t value = other._max.load(std::memory_order_relaxed);
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	void Histogram::reset() {
+		for (auto& b : _buckets) {
+			b.store(0, std::memory_order_relaxed);
+		}
+		_count = 0;
+		_sum = 0;
+		_max = 0;
+	}
+
+	uint64_t Histogram::percentile(double q) const {
+		uint64_t count = _count;
+		if (count == 0) {
+			return 0;
+		}
+		uint64_t target = (uint64_t)std::ceil(q * count);
+		if (target == 0) {
+			target = 1;
+		}
+		uint64_t seen = 0;
+		for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+			seen += _buckets[b].load(std::memory_order_relaxed);
+			if (seen >= target) {
+				// never report more than was recorded
+				uint64_t limit = bucketLimit(b);
+				uint64_t max = _max;
+				return limit < max ? limit : max;
+			}
+		}
+		return _max;
+	}
+}
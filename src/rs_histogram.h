@@ -0,0 +1,42 @@
+#ifndef RSHISTOGRAM_H
+#define RSHISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+namespace rsw {
+	/// Lock-free histogram of non-negative values such as latencies in microseconds.
+	/// Values below 16 are counted exactly, larger ones in 16 buckets per power of two,
+	/// so percentiles are accurate to within about 6%.
+	class Histogram {
+	public:
+		Histogram();
+
+		void record(uint64_t value);
+		/// Adds the values recorded in other, which may be updated meanwhile
+		void add(const Histogram& other);
+		void reset();
+
+		uint64_t getCount() const { return _count; }
+		uint64_t getSum() const { return _sum; }
+		uint64_t getMax() const { return _max; }
+		/// Returns the value that fraction q of the recorded values do not exceed, rounded up
+		/// to the end of its bucket. Returns 0 if nothing was recorded.
+		uint64_t percentile(double q) const;
+
+		static const size_t BUCKET_COUNT = 16 + 60 * 16;
+		static size_t bucketFor(uint64_t value);
+		/// Largest value counted in bucket b
+		static uint64_t bucketLimit(size_t b);
+		uint64_t getBucket(size_t b) const { return _buckets[b]; }
+
+	private:
+		std::atomic<uint64_t> _buckets[BUCKET_COUNT];
+		std::atomic<uint64_t> _count;
+		std::atomic<uint64_t> _sum;
+		std::atomic<uint64_t> _max;
+	};
+}
+
+#endif
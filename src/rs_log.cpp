@@ -0,0 +1,34 @@
+#include <iostream>
+#include <mutex>
+
+#include "rs_log.h"
+
+namespace rsw {
+	std::atomic<int> logThreshold(LOG_INFO);
+
+	void setLogLevel(LogLevel level) {
+		logThreshold.store(level, std::memory_order_relaxed);
+	}
+
+	LogLevel getLogLevel() {
+		return (LogLevel)logThreshold.load(std::memory_order_relaxed);
+	}
+
+	const char* getLogLevelName(LogLevel level) {
+		switch (level) {
+		case LOG_TRACE: return "trace";
+		case LOG_DEBUG: return "debug";
+		case LOG_INFO: return "info";
+		case LOG_WARN: return "warn";
+		case LOG_ERROR: return "error";
+		default: return "off";
+		}
+	}
+
+	void writeLog(LogLevel level, const std::string& message) {
+		static std::mutex m;
+		std::lock_guard<std::mutex> lock(m);
+		std::ostream& out = level >= LOG_WARN ? std::cerr : std::cout;
+		out << "[" << getLogLevelName(level) << "] " << message << std::endl;
+	}
+}
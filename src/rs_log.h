@@ -0,0 +1,51 @@
+#ifndef RSLOG_H
+#define RSLOG_H
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+// Messages below this level are compiled out, the runtime level can only raise it further
+#ifndef RSW_LOG_MIN_LEVEL
+#define RSW_LOG_MIN_LEVEL rsw::LOG_TRACE
+#endif
+
+/// Logs message, anything that can be streamed to an std::ostream, if level is enabled.
+/// A disabled message costs one relaxed load and is never formatted.
+#define RSW_LOG(level, message) \
+	do { \
+		if ((level) >= RSW_LOG_MIN_LEVEL && rsw::isLogEnabled(level)) { \
+			std::ostringstream rswLogStream; \
+			rswLogStream << message; \
+			rsw::writeLog((level), rswLogStream.str()); \
+		} \
+	} while (0)
+
+namespace rsw {
+	enum LogLevel {
+		LOG_TRACE = 0, // every frame, for debugging the capture and write paths
+		LOG_DEBUG,
+		LOG_INFO,
+		LOG_WARN,
+		LOG_ERROR,
+		LOG_OFF
+	};
+
+	// read by isLogEnabled, set through setLogLevel
+	extern std::atomic<int> logThreshold;
+
+	/// Defaults to LOG_INFO
+	void setLogLevel(LogLevel level);
+	LogLevel getLogLevel();
+	const char* getLogLevelName(LogLevel level);
+
+	inline bool isLogEnabled(LogLevel level) {
+		return level >= logThreshold.load(std::memory_order_relaxed);
+	}
+
+	/// Writes a line to stderr for warnings and errors, to stdout otherwise. Lines from
+	/// different threads are not interleaved.
+	void writeLog(LogLevel level, const std::string& message);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <string>
+
+#include "rs_wrapper.h"
+#include "glfw3.h"
+
+#define TEST_SERIAL "023150187408"
+
+using namespace std;
+
+int main(void) try {
+	std::string dirName = "C:\\Users\\yimmy\\Documents\\work\\CAMP2016\\rswrapper_frames";
+	rsw::RealSenseWrapper realsense(dirName);
+
+	// TEST: get list of devices
+	std::vector<std::string>* deviceList = realsense.getDeviceList();
+	for (auto str : *deviceList) {
+		std::cout << "Device Serial: " << str << std::endl;
+	}
+	delete deviceList;
+
+	// TEST: print status of devices (attached/not attached, available playback, if stream is streaming)
+	realsense.printStatus();
+
+	rsw::FrameHandle depthFrame;
+	rsw::FrameHandle colorFrame;
+	int ret;
+
+	// TEST: starting multiple streams
+	ret = realsense.enableStream(TEST_SERIAL, rs::stream::color, "serial_color", 640, 480, rs::format::rgb8, 30);
+	ret = realsense.enableStream(TEST_SERIAL, rs::stream::depth, "serial_depth", 640, 480, rs::format::z16, 30);
+
+	ret = realsense.startDevice(TEST_SERIAL);
+
+	// TEST: stopping all streams
+	ret = realsense.stopDevice(TEST_SERIAL);
+
+	// TEST: grabbing frame data from stopped stream and from live stream
+	glfwInit();
+	GLFWwindow * win = glfwCreateWindow(1300, 1000, "depth and color", nullptr, nullptr);
+	while (true) {
+		ret = realsense.getFrame(colorFrame, TEST_SERIAL, rs::stream::color, "serial_color");
+		ret = realsense.getFrame(depthFrame, TEST_SERIAL, rs::stream::depth, "serial_depth", rs::format::rgb8);
+		ret = 1;
+		glfwPollEvents();
+		if (ret == rsw::RealSenseWrapper::RSError::NO_ERROR) {
+			glfwMakeContextCurrent(win);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glPixelZoom(1, -1);
+			glRasterPos2f(0, 1);
+			glDrawPixels(colorFrame.width(), colorFrame.height(), GL_RGB, GL_UNSIGNED_BYTE, colorFrame.data());
+			if (!depthFrame.empty()) {
+				glRasterPos2f(-1, 1);
+				glDrawPixels(depthFrame.width(), depthFrame.height(), GL_RGB, GL_UNSIGNED_BYTE, depthFrame.data());
+			}
+			glfwSwapBuffers(win);
+		}
+	}
+
+	glfwTerminate();
+
+	ret = realsense.stopDevice(TEST_SERIAL);
+
+	// TODO: test stream name conflicts
+	std::cout << "Waiting...";
+	std::string i;
+	std::cin >> i;
+	return 0;
+}
+catch (const rs::error & e)
+{
+	std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
+catch (const std::exception & e) {
+	std::cout << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
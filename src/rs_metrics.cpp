@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include "rs_log.h"
+#include "rs_metrics.h"
+
+namespace rsw {
+	namespace {
+		struct MetricInfo {
+			const char* name;
+			const char* help;
+		};
+
+		const MetricInfo COUNTER_INFO[COUNTER_COUNT] = {
+			{ "frames_captured", "Frames taken from the device" },
+			{ "frames_written", "Frames written to segment files" },
+			{ "frames_dropped", "Frames dropped by the writer queue's overflow policy" },
+			{ "write_errors", "Frames that could not be written" },
+			{ "bytes_written", "Frame payload bytes written, after compression" }
+		};
+
+		const MetricInfo HISTOGRAM_INFO[HISTOGRAM_COUNT] = {
+			{ "capture_to_write_us", "Microseconds from capturing a frame until it is written" },
+			{ "write_us", "Microseconds taken by the write of a batch of frames" },
+			{ "lock_wait_ns", "Nanoseconds spent waiting for the writer queue when submitting a frame" },
+			{ "queue_depth", "Frames queued ahead of a frame when it is submitted" }
+		};
+
+		std::atomic<size_t> nextMetricsId(0);
+
+		std::string escapeLabel(const std::string& value) {
+			std::string out;
+			for (char c : value) {
+				if (c == '\\' || c == '"') {
+					out += '\\';
+					out += c;
+				} else if (c == '\n') {
+					out += "\\n";
+				} else {
+					out += c;
+				}
+			}
+			return out;
+		}
+	}
+
+	const char* getMetricName(MetricCounter c) {
+		return c >= 0 && c < COUNTER_COUNT ? COUNTER_INFO[c].name : "unknown";
+	}
+
+	const char* getMetricName(MetricHistogram h) {
+		return h >= 0 && h < HISTOGRAM_COUNT ? HISTOGRAM_INFO[h].name : "unknown";
+	}
+
+	StreamMetrics::Cell::Cell() {
+		for (auto& c : counters) {
+			c = 0;
+		}
+	}
+
+	StreamMetrics::StreamMetrics(std::string serial, std::string stream, std::string name) :
+								 _id(nextMetricsId++), _serial(serial), _stream(stream), _name(name),
+								 _cells(), _m() {
+	}
+
+	StreamMetrics::~StreamMetrics() {
+		for (auto cell : _cells) {
+			delete cell;
+		}
+	}
+
+	StreamMetrics::Cell* StreamMetrics::local() {
+		// the calling thread's cell of every StreamMetrics, by id
+		thread_local std::vector<Cell*> cells;
+		if (_id < cells.size() && cells[_id] != nullptr) {
+			return cells[_id];
+		}
+		return addCell(cells);
+	}
+
+	StreamMetrics::Cell* StreamMetrics::addCell(std::vector<Cell*>& threadCells) {
+		Cell* cell = new Cell();
+		{
+			std::lock_guard<std::mutex> lock(_m);
+			_cells.push_back(cell);
+		}
+		if (threadCells.size() <= _id) {
+			threadCells.resize(_id + 1, nullptr);
+		}
+		threadCells[_id] = cell;
+		return cell;
+	}
+
+	StreamMetricsSnapshot StreamMetrics::snapshot() {
+		StreamMetricsSnapshot s;
+		s.serial = _serial;
+		s.stream = _stream;
+		s.name = _name;
+		std::fill(s.counters, s.counters + COUNTER_COUNT, 0);
+
+		std::unique_ptr<Histogram[]> merged(new Histogram[HISTOGRAM_COUNT]);
+		{
+			std::lock_guard<std::mutex> lock(_m);
+			for (auto cell : _cells) {
+				for (int c = 0; c < COUNTER_COUNT; ++c) {
+					s.counters[c] += cell->counters[c].load(std::memory_order_relaxed);
+				}
+				for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+					merged[h].add(cell->histograms[h]);
+				}
+			}
+		}
+		for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+			const Histogram& m = merged[h];
+			s.histograms[h] = { m.getCount(), m.getSum(), m.getMax(), m.percentile(0.5), m.percentile(0.9),
+				m.percentile(0.99) };
+		}
+		return s;
+	}
+
+	MetricsRegistry::MetricsRegistry() : _streams(), _m(), _dumpFile(), _dumpInterval(0), _dumping(false),
+										 _dumpThread(nullptr) {
+	}
+
+	MetricsRegistry::~MetricsRegistry() {
+		stopDump();
+	}
+
+	std::shared_ptr<StreamMetrics> MetricsRegistry::getStream(const std::string& serial,
+		const std::string& stream, const std::string& name) {
+		std::lock_guard<std::mutex> lock(_m);
+		for (auto& s : _streams) {
+			if (s->getSerial() == serial && s->getStream() == stream && s->getName() == name) {
+				return s;
+			}
+		}
+		_streams.push_back(std::make_shared<StreamMetrics>(serial, stream, name));
+		return _streams.back();
+	}
+
+	std::vector<StreamMetricsSnapshot> MetricsRegistry::snapshot() {
+		std::vector<std::shared_ptr<StreamMetrics>> streams;
+		{
+			std::lock_guard<std::mutex> lock(_m);
+			streams = _streams;
+		}
+		std::vector<StreamMetricsSnapshot> snapshots;
+		for (auto& s : streams) {
+			snapshots.push_back(s->snapshot());
+		}
+		return snapshots;
+	}
+
+	std::string MetricsRegistry::toPrometheus(const std::vector<StreamMetricsSnapshot>& snapshots) {
+		std::vector<std::string> labels;
+		for (auto& s : snapshots) {
+			labels.push_back("serial=\"" + escapeLabel(s.serial) + "\",stream=\"" + escapeLabel(s.stream) +
+				"\",name=\"" + escapeLabel(s.name) + "\"");
+		}
+
+		// all samples of a metric have to follow its TYPE line
+		std::ostringstream out;
+		for (int c = 0; c < COUNTER_COUNT; ++c) {
+			std::string metric = std::string("rsw_") + COUNTER_INFO[c].name + "_total";
+			out << "# HELP " << metric << " " << COUNTER_INFO[c].help << "\n";
+			out << "# TYPE " << metric << " counter\n";
+			for (size_t i = 0; i < snapshots.size(); ++i) {
+				out << metric << "{" << labels[i] << "} " << snapshots[i].counters[c] << "\n";
+			}
+		}
+		for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+			std::string metric = std::string("rsw_") + HISTOGRAM_INFO[h].name;
+			out << "# HELP " << metric << " " << HISTOGRAM_INFO[h].help << "\n";
+			out << "# TYPE " << metric << " summary\n";
+			for (size_t i = 0; i < snapshots.size(); ++i) {
+				const HistogramSummary& sum = snapshots[i].histograms[h];
+				out << metric << "{" << labels[i] << ",quantile=\"0.5\"} " << sum.p50 << "\n";
+				out << metric << "{" << labels[i] << ",quantile=\"0.9\"} " << sum.p90 << "\n";
+				out << metric << "{" << labels[i] << ",quantile=\"0.99\"} " << sum.p99 << "\n";
+				out << metric << "_sum{" << labels[i] << "} " << sum.sum << "\n";
+				out << metric << "_count{" << labels[i] << "} " << sum.count << "\n";
+			}
+			out << "# HELP " << metric << "_max Largest value recorded\n";
+			out << "# TYPE " << metric << "_max gauge\n";
+			for (size_t i = 0; i < snapshots.size(); ++i) {
+				out << metric << "_max{" << labels[i] << "} " << snapshots[i].histograms[h].max << "\n";
+			}
+		}
+		return out.str();
+	}
+
+	bool MetricsRegistry::writePrometheus(const fs::path& file) {
+		std::string text = toPrometheus(snapshot());
+		fs::path tmp = file;
+		tmp += ".tmp";
+		{
+			fs::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+			out.write(text.data(), text.size());
+			if (!out) {
+				return false;
+			}
+		}
+		boost::system::error_code ec;
+		fs::rename(tmp, file, ec);
+		return !ec;
+	}
+
+	void MetricsRegistry::startDump(const fs::path& file, int intervalMs) {
+		stopDump();
+		std::lock_guard<std::mutex> lock(_dumpM);
+		_dumpFile = file;
+		_dumpInterval = std::max(intervalMs, 1);
+		_dumping = true;
+		_dumpThread = new std::thread(&MetricsRegistry::dumpLoop, this);
+	}
+
+	void MetricsRegistry::stopDump() {
+		_dumpM.lock();
+		if (!_dumping) {
+			_dumpM.unlock();
+			return;
+		}
+		_dumping = false;
+		_dumpM.unlock();
+		_dumpCv.notify_all();
+
+		_dumpThread->join();
+		delete _dumpThread;
+		_dumpThread = nullptr;
+	}
+
+	void MetricsRegistry::dumpLoop() {
+		std::unique_lock<std::mutex> lock(_dumpM);
+		fs::path file = _dumpFile;
+		while (true) {
+			lock.unlock();
+			if (!writePrometheus(file)) {
+				RSW_LOG(LOG_WARN, "Unable to write metrics to " << file);
+			}
+			lock.lock();
+			// the last pass after stopping leaves the final totals in the file
+			if (!_dumping) {
+				break;
+			}
+			_dumpCv.wait_for(lock, std::chrono::milliseconds(_dumpInterval), [this] { return !_dumping; });
+		}
+	}
+}
@@ -0,0 +1,146 @@
+#ifndef RSMETRICS_H
+#define RSMETRICS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "rs_histogram.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	enum MetricCounter {
+		FRAMES_CAPTURED = 0,
+		FRAMES_WRITTEN,
+		FRAMES_DROPPED, // by the writer queue's overflow policy
+		WRITE_ERRORS,
+		BYTES_WRITTEN,  // payload as stored, after compression
+		COUNTER_COUNT
+	};
+
+	enum MetricHistogram {
+		CAPTURE_TO_WRITE_US = 0, // from the capture thread picking a frame up until it is on disk
+		WRITE_US,                // write calls of the stream's batches
+		LOCK_WAIT_NS,            // submitting a frame waiting for the writer queue, its lock or space in it
+		QUEUE_DEPTH,             // frames ahead of a frame in the writer queue when it is submitted
+		HISTOGRAM_COUNT
+	};
+
+	const char* getMetricName(MetricCounter c);
+	const char* getMetricName(MetricHistogram h);
+
+	/// Summary of the values recorded in a histogram
+	struct HistogramSummary {
+		uint64_t count;
+		uint64_t sum;
+		uint64_t max;
+		uint64_t p50;
+		uint64_t p90;
+		uint64_t p99;
+	};
+
+	/// Totals of one stream at the time of the snapshot
+	struct StreamMetricsSnapshot {
+		std::string serial;
+		std::string stream;
+		std::string name;
+		uint64_t counters[COUNTER_COUNT];
+		HistogramSummary histograms[HISTOGRAM_COUNT];
+	};
+
+	/// Counters and histograms of one stream. Every thread updating them gets its own copy,
+	/// so the frame path never shares a cache line or takes a lock, only a thread's first
+	/// update does. Snapshots add up the copies.
+	class StreamMetrics {
+	public:
+		StreamMetrics(std::string serial, std::string stream, std::string name);
+		~StreamMetrics();
+
+		void count(MetricCounter c, uint64_t n = 1) {
+			// only this thread writes the cell, a load and a store are enough
+			std::atomic<uint64_t>& counter = local()->counters[c];
+			counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+		void record(MetricHistogram h, uint64_t value) {
+			local()->histograms[h].record(value);
+		}
+
+		StreamMetricsSnapshot snapshot();
+
+		const std::string& getSerial() const { return _serial; }
+		const std::string& getStream() const { return _stream; }
+		const std::string& getName() const { return _name; }
+
+	private:
+		struct alignas(64) Cell {
+			Cell();
+			std::atomic<uint64_t> counters[COUNTER_COUNT];
+			Histogram histograms[HISTOGRAM_COUNT];
+		};
+
+		// indexes the calling thread's cells, never reused
+		const size_t _id;
+		const std::string _serial;
+		const std::string _stream;
+		const std::string _name;
+		// cells of all threads, guarded by _m
+		std::vector<Cell*> _cells;
+		std::mutex _m;
+
+		Cell* local();
+		Cell* addCell(std::vector<Cell*>& threadCells);
+
+		StreamMetrics(const StreamMetrics&);
+		StreamMetrics& operator=(const StreamMetrics&);
+	};
+
+	/// Metrics of all streams, with an optional thread writing them to a file in the
+	/// Prometheus text format, as read by the node exporter's textfile collector
+	class MetricsRegistry {
+	public:
+		MetricsRegistry();
+		/// Stops the dump thread
+		~MetricsRegistry();
+
+		/// Returns the metrics of a stream, the same object for the same labels. Kept until
+		/// the registry is destroyed, so totals survive the stream being disabled.
+		std::shared_ptr<StreamMetrics> getStream(const std::string& serial, const std::string& stream,
+			const std::string& name);
+
+		std::vector<StreamMetricsSnapshot> snapshot();
+
+		/// Returns the snapshots in the Prometheus text exposition format
+		static std::string toPrometheus(const std::vector<StreamMetricsSnapshot>& snapshots);
+		/// Replaces file with the current metrics, readers never see a partial file.
+		/// Returns false if unable to write it.
+		bool writePrometheus(const fs::path& file);
+
+		/// Writes the metrics to file every intervalMs until stopDump or another startDump
+		void startDump(const fs::path& file, int intervalMs);
+		void stopDump();
+
+	private:
+		std::vector<std::shared_ptr<StreamMetrics>> _streams;
+		std::mutex _m;
+
+		fs::path _dumpFile;
+		int _dumpInterval;
+		bool _dumping;
+		std::thread* _dumpThread;
+		std::mutex _dumpM;
+		std::condition_variable _dumpCv;
+
+		void dumpLoop();
+	};
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include <algorithm>
+
+#include "rs_log.h"
+#include "rs_playback.h"
+
+namespace rsw {
+	namespace {
+		const size_t PAGE_BYTES = 4096;
+
+		/// Reads a byte of every page of a frame, so a mapped frame is paged in by the
+		/// calling thread rather than by whoever touches the pixels first
+		void faultIn(const FrameHandle& frame) {
+			volatile char sink;
+			for (size_t i = 0; i < frame.size(); i += PAGE_BYTES) {
+				sink = frame.data()[i];
+			}
+			(void)sink;
+		}
+	}
+
+	PlaybackSession::PlaybackSession(std::vector<fs::path> recordings, double rate, size_t bufferFrames) :
+									 _members(), _startTimestamp(-1), _endTimestamp(-1),
+									 _capacity(std::max<size_t>(bufferFrames, 1)), _buffer(), _generation(0),
+									 _seekTimestamp(-1), _ended(false), _shutdown(false), _thread(nullptr),
+									 _rate(std::max(rate, 0.0)), _anchored(false), _anchorTime(), _anchorTimestamp(0),
+									 _delivered(0), _bytes(0), _late(0), _stalls(0), _played(0), _lastTimestamp(-1),
+									 _firstDelivery(), _lastDelivery() {
+		for (auto& dir : recordings) {
+			Member* member = new Member(dir);
+			_members.push_back(member);
+			const TimestampIndex& index = member->reader.getIndex();
+			if (index.size() == 0) {
+				continue;
+			}
+			int first = index.begin()->timestamp;
+			int last = (index.end() - 1)->timestamp;
+			_startTimestamp = _startTimestamp == -1 ? first : std::min(_startTimestamp, first);
+			_endTimestamp = std::max(_endTimestamp, last);
+		}
+		_thread = new std::thread(&PlaybackSession::readAheadLoop, this);
+	}
+
+	PlaybackSession::~PlaybackSession() {
+		_m.lock();
+		_shutdown = true;
+		_m.unlock();
+		_notFull.notify_all();
+		_notEmpty.notify_all();
+		_thread->join();
+		delete _thread;
+
+		// the buffered frames may point into the readers' mappings, the handles keep those alive
+		_buffer.clear();
+		for (auto member : _members) {
+			delete member;
+		}
+	}
+
+	bool PlaybackSession::next(PlaybackFrame& out) {
+		std::unique_lock<std::mutex> lock(_m);
+		while (true) {
+			if (_shutdown) {
+				return false;
+			}
+			if (_buffer.empty()) {
+				if (_ended) {
+					return false;
+				}
+				++_stalls;
+				_notEmpty.wait(lock, [this] { return !_buffer.empty() || _ended || _shutdown; });
+				continue;
+			}
+
+			int timestamp = _buffer.front().frame.timestamp();
+			Clock::time_point now = Clock::now();
+			bool late = false;
+			if (_rate > 0.0) {
+				if (!_anchored) {
+					_anchored = true;
+					_anchorTime = now;
+					_anchorTimestamp = timestamp;
+				}
+				Clock::time_point due = _anchorTime + std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double, std::milli>((timestamp - _anchorTimestamp) / _rate));
+				if (now < due) {
+					// a seek or rate change while waiting makes another frame, or this one at
+					// another time, due next
+					uint64_t generation = _generation;
+					_notEmpty.wait_until(lock, due, [this, generation] {
+						return _generation != generation || !_anchored || _shutdown;
+					});
+					continue;
+				}
+				late = now - due > std::chrono::milliseconds(1);
+			}
+
+			out = std::move(_buffer.front());
+			_buffer.pop_front();
+			if (_delivered == 0) {
+				_firstDelivery = now;
+			}
+			_lastDelivery = now;
+			++_delivered;
+			_bytes += out.frame.size();
+			if (late) {
+				++_late;
+			}
+			if (_lastTimestamp != -1 && timestamp > _lastTimestamp) {
+				_played += timestamp - _lastTimestamp;
+			}
+			_lastTimestamp = timestamp;
+			lock.unlock();
+			_notFull.notify_one();
+			return true;
+		}
+	}
+
+	void PlaybackSession::seek(int timestamp) {
+		std::deque<PlaybackFrame> dropped;
+		_m.lock();
+		++_generation;
+		_seekTimestamp = timestamp;
+		// dropping the frames outside the lock, they may hold the last reference to a mapping
+		dropped.swap(_buffer);
+		_ended = false;
+		_anchored = false;
+		_lastTimestamp = -1;
+		_m.unlock();
+		_notFull.notify_all();
+		_notEmpty.notify_all();
+	}
+
+	void PlaybackSession::setRate(double rate) {
+		_m.lock();
+		_rate = std::max(rate, 0.0);
+		_anchored = false;
+		_m.unlock();
+		_notEmpty.notify_all();
+	}
+
+	double PlaybackSession::getRate() {
+		std::lock_guard<std::mutex> lock(_m);
+		return _rate;
+	}
+
+	PlaybackStats PlaybackSession::getStats() {
+		std::lock_guard<std::mutex> lock(_m);
+		PlaybackStats stats = { _delivered, _bytes, 0.0, 0.0, 0.0, 0.0, _late, _stalls };
+		stats.seconds = std::chrono::duration<double>(_lastDelivery - _firstDelivery).count();
+		if (stats.seconds > 0.0) {
+			stats.fps = _delivered / stats.seconds;
+			stats.mbPerSecond = _bytes / stats.seconds / (1024.0 * 1024.0);
+			stats.rate = _played / (stats.seconds * 1000.0);
+		}
+		return stats;
+	}
+
+	void PlaybackSession::readAheadLoop() {
+		std::unique_lock<std::mutex> lock(_m);
+		uint64_t generation = _generation;
+		while (true) {
+			_notFull.wait(lock, [this, generation] {
+				return _shutdown || _generation != generation || (!_ended && _buffer.size() < _capacity);
+			});
+			if (_shutdown) {
+				return;
+			}
+			if (_generation != generation) {
+				generation = _generation;
+				int timestamp = _seekTimestamp;
+				lock.unlock();
+				position(timestamp);
+				lock.lock();
+				continue;
+			}
+			lock.unlock();
+
+			size_t next = earliest();
+			if (next == _members.size()) {
+				// pick up frames recorded since
+				for (auto m : _members) {
+					refresh(m);
+				}
+				next = earliest();
+			}
+
+			PlaybackFrame frame;
+			bool read = false;
+			if (next < _members.size()) {
+				Member* member = _members[next];
+				const TimestampIndexEntry& e = member->reader.getIndex().begin()[member->position++];
+				if (e.timestamp == member->timestamp) {
+					++member->skip;
+				} else {
+					member->timestamp = e.timestamp;
+					member->skip = 1;
+				}
+				frame.member = next;
+				read = member->reader.mapEntry(e, frame.frame);
+				if (read) {
+					faultIn(frame.frame);
+				} else {
+					RSW_LOG(LOG_WARN, "Skipping unreadable frame " << e.timestamp << " during playback");
+				}
+			}
+
+			lock.lock();
+			if (_generation != generation) {
+				// seeked meanwhile, drop the frame outside the lock
+				lock.unlock();
+				frame.frame.reset();
+				lock.lock();
+				continue;
+			}
+			if (next == _members.size()) {
+				_ended = true;
+				_notEmpty.notify_all();
+			} else if (read) {
+				_buffer.push_back(std::move(frame));
+				_notEmpty.notify_one();
+			}
+		}
+	}
+
+	void PlaybackSession::position(int timestamp) {
+		for (auto member : _members) {
+			member->timestamp = timestamp;
+			member->skip = 0;
+			refresh(member);
+		}
+	}
+
+	void PlaybackSession::refresh(Member* member) {
+		member->reader.refresh();
+		const TimestampIndex& index = member->reader.getIndex();
+		const TimestampIndexEntry* e = index.seek(member->timestamp, TimestampIndex::CEIL);
+		size_t first = e == nullptr ? index.size() : e - index.begin();
+		member->position = std::min(first + member->skip, index.size());
+	}
+
+	size_t PlaybackSession::earliest() {
+		size_t earliest = _members.size();
+		int timestamp = 0;
+		// ties go to the member listed first
+		for (size_t i = 0; i < _members.size(); ++i) {
+			const TimestampIndex& index = _members[i]->reader.getIndex();
+			if (_members[i]->position >= index.size()) {
+				continue;
+			}
+			int t = index.begin()[_members[i]->position].timestamp;
+			if (earliest == _members.size() || t < timestamp) {
+				earliest = i;
+				timestamp = t;
+			}
+		}
+		return earliest;
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef RSPLAYBACK_H
+#define RSPLAYBACK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include <boost/filesystem.hpp>
+
+#include "rs_frame_handle.h"
+#include "rs_recording.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	// frames read ahead of the one being delivered, over all streams of a session
+	const size_t DEFAULT_PLAYBACK_BUFFER = 64;
+
+	/// One frame delivered by a PlaybackSession
+	struct PlaybackFrame {
+		// index of the frame's stream in the recordings the session was opened with
+		size_t member;
+		FrameHandle frame;
+	};
+
+	/// Playback throughput since the session was opened
+	struct PlaybackStats {
+		uint64_t frames;
+		uint64_t bytes;
+		// wall time from the first frame delivered to the last
+		double seconds;
+		double fps;
+		double mbPerSecond;
+		// recorded time played per wall time, the achieved playback rate
+		double rate;
+		// frames delivered more than a millisecond after they were due
+		uint64_t late;
+		// times next had to wait for the read ahead thread
+		uint64_t stalls;
+	};
+
+	/// Plays one or more recordings back in timestamp order. A thread reads and decodes
+	/// upcoming frames into a bounded buffer and faults their pages in, so the caller of
+	/// next only waits for the frames' due time. Frames are paced to the recorded
+	/// timestamps at rate times real time, or delivered as fast as they can be read.
+	/// Timestamps of all recordings are taken to be on one clock, streams of different
+	/// devices play in the order of their own device clocks.
+	/// next is called from one thread, seek and setRate may be called from any thread.
+	class PlaybackSession {
+	public:
+		/// rate 0 plays as fast as frames can be read. Frames appended to the recordings
+		/// while playing are picked up when playback reaches their end, those older than
+		/// the frames already played are skipped.
+		PlaybackSession(std::vector<fs::path> recordings, double rate = 1.0,
+			size_t bufferFrames = DEFAULT_PLAYBACK_BUFFER);
+		/// Stops the read ahead thread, frames already delivered stay valid
+		~PlaybackSession();
+
+		/// Waits until the next frame is due and returns it. Returns false once all
+		/// recordings have been played to the end.
+		bool next(PlaybackFrame& out);
+		/// Continues playback with the first frame of each recording at or after timestamp,
+		/// frames read ahead are dropped
+		void seek(int timestamp);
+		/// Takes effect from the next frame on, 0 plays as fast as frames can be read
+		void setRate(double rate);
+		double getRate();
+
+		/// Earliest and latest timestamp over all recordings when the session was opened,
+		/// -1 if they are empty
+		int getStartTimestamp() const { return _startTimestamp; }
+		int getEndTimestamp() const { return _endTimestamp; }
+		size_t getMemberCount() const { return _members.size(); }
+
+		PlaybackStats getStats();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		// only used by the read ahead thread
+		struct Member {
+			Member(fs::path dir) : reader(dir), position(0), timestamp(INT_MIN), skip(0) {}
+
+			RecordingReader reader;
+			// index entry read next
+			size_t position;
+			// the same place by timestamp, skip entries past the first one at or after
+			// timestamp. Refreshing an unsorted index can merge late entries in ahead of
+			// position, it is found again from these.
+			int timestamp;
+			size_t skip;
+		};
+
+		std::vector<Member*> _members;
+		int _startTimestamp;
+		int _endTimestamp;
+
+		size_t _capacity;
+		std::deque<PlaybackFrame> _buffer;
+		// bumped by every seek, frames read for an older generation are dropped
+		uint64_t _generation;
+		int _seekTimestamp;
+		// the read ahead thread reached the end of all recordings of this generation
+		bool _ended;
+		bool _shutdown;
+		std::mutex _m;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+		std::thread* _thread;
+
+		// pacing, frames are due at _anchorTime plus their distance to _anchorTimestamp
+		// divided by the rate. Anchored again by the first frame after a seek or rate change.
+		double _rate;
+		bool _anchored;
+		Clock::time_point _anchorTime;
+		int _anchorTimestamp;
+
+		// guarded by _m
+		uint64_t _delivered;
+		uint64_t _bytes;
+		uint64_t _late;
+		uint64_t _stalls;
+		// recorded ms covered by the frames delivered, excluding jumps of a seek
+		int64_t _played;
+		int _lastTimestamp;
+		Clock::time_point _firstDelivery;
+		Clock::time_point _lastDelivery;
+
+		void readAheadLoop();
+		/// Moves every member to its first frame at or after timestamp
+		void position(int timestamp);
+		/// Picks up frames appended to a member's recording and finds its place again
+		void refresh(Member* member);
+		/// Returns the index of the member whose next frame is earliest, the member count
+		/// at the end of all of them
+		size_t earliest();
+
+		PlaybackSession(const PlaybackSession&);
+		PlaybackSession& operator=(const PlaybackSession&);
+	};
+}
+
+#endif
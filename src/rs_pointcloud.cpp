@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rs_simd.h"
+#include "rs_convert.h"
+#include "rs_pointcloud.h"
+
+namespace rsw {
+	struct PointCloudGenerator::Model {
+		// direction through every depth pixel, at a depth of 1
+		std::vector<float> rayX;
+		std::vector<float> rayY;
+		float depthScale;
+		bool registered;
+		// depth to color camera, rotation column major
+		float rotation[9];
+		float translation[3];
+		// color camera
+		float fx;
+		float fy;
+		float ppx;
+		float ppy;
+		bool distorted;
+		float coeffs[5];
+		int colorWidth;
+		int colorHeight;
+		// projections with minU <= u < maxU and minV <= v < maxV fall on a color pixel
+		float minU;
+		float maxU;
+		float minV;
+		float maxV;
+	};
+
+	typedef PointCloudGenerator::Model Model;
+
+	// Extrinsics map p to rotation * p + translation, the rotation is stored column major
+	static rs_extrinsics invert(const rs_extrinsics& e) {
+		rs_extrinsics inv;
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				inv.rotation[c * 3 + r] = e.rotation[r * 3 + c];
+			}
+		}
+		for (int r = 0; r < 3; ++r) {
+			inv.translation[r] = -(inv.rotation[r] * e.translation[0] + inv.rotation[3 + r] * e.translation[1] +
+				inv.rotation[6 + r] * e.translation[2]);
+		}
+		return inv;
+	}
+
+	// Applies first, then second
+	static rs_extrinsics compose(const rs_extrinsics& first, const rs_extrinsics& second) {
+		rs_extrinsics e;
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				float sum = 0.0f;
+				for (int k = 0; k < 3; ++k) {
+					sum += second.rotation[k * 3 + r] * first.rotation[c * 3 + k];
+				}
+				e.rotation[c * 3 + r] = sum;
+			}
+			float sum = second.translation[r];
+			for (int k = 0; k < 3; ++k) {
+				sum += second.rotation[k * 3 + r] * first.translation[k];
+			}
+			e.translation[r] = sum;
+		}
+		return e;
+	}
+
+	// Same arithmetic in the same order as rs_project_point_to_pixel, the SIMD kernels follow it
+	static inline void projectScalar(const Model& m, float x, float y, float z, float& u, float& v) {
+		float px = x / z;
+		float py = y / z;
+		if (m.distorted) {
+			const float* k = m.coeffs;
+			float r2 = px * px + py * py;
+			float f = 1 + k[0] * r2 + k[1] * r2 * r2 + k[4] * r2 * r2 * r2;
+			px *= f;
+			py *= f;
+			float dx = px + 2 * k[2] * px * py + k[3] * (r2 + 2 * px * px);
+			float dy = py + 2 * k[3] * px * py + k[2] * (r2 + 2 * py * py);
+			px = dx;
+			py = dy;
+		}
+		float pu = px * m.fx + m.ppx;
+		float pv = py * m.fy + m.ppy;
+		bool inside = z > 0 && pu >= m.minU && pu < m.maxU && pv >= m.minV && pv < m.maxV;
+		u = inside ? pu : -1.0f;
+		v = inside ? pv : -1.0f;
+	}
+
+	static void deprojectScalar(const Model& m, const uint16_t* depth, const PointCloud& out,
+		size_t begin, size_t end) {
+		const float* r = m.rotation;
+		const float* t = m.translation;
+		for (size_t i = begin; i < end; ++i) {
+			float z = (float)depth[i] * m.depthScale;
+			float x = z * m.rayX[i];
+			float y = z * m.rayY[i];
+			if (!m.registered) {
+				out.x[i] = x;
+				out.y[i] = y;
+				out.z[i] = z;
+				continue;
+			}
+			if (depth[i] == 0) {
+				out.x[i] = out.y[i] = out.z[i] = 0.0f;
+				if (out.u != nullptr) {
+					out.u[i] = out.v[i] = -1.0f;
+				}
+				continue;
+			}
+
+			float cx = r[0] * x + r[3] * y + r[6] * z + t[0];
+			float cy = r[1] * x + r[4] * y + r[7] * z + t[1];
+			float cz = r[2] * x + r[5] * y + r[8] * z + t[2];
+			out.x[i] = cx;
+			out.y[i] = cy;
+			out.z[i] = cz;
+			if (out.u != nullptr) {
+				projectScalar(m, cx, cy, cz, out.u[i], out.v[i]);
+			}
+		}
+	}
+
+#ifdef RSW_X86
+	RSW_TARGET("sse2") static inline void transformSse2(const Model& m, __m128& x, __m128& y, __m128& z) {
+		__m128 to[3];
+		for (int r = 0; r < 3; ++r) {
+			to[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(m.rotation[r]), x),
+				_mm_mul_ps(_mm_set1_ps(m.rotation[3 + r]), y)),
+				_mm_mul_ps(_mm_set1_ps(m.rotation[6 + r]), z)),
+				_mm_set1_ps(m.translation[r]));
+		}
+		x = to[0];
+		y = to[1];
+		z = to[2];
+	}
+
+	RSW_TARGET("sse2") static inline void projectSse2(const Model& m, __m128 x, __m128 y, __m128 z,
+		__m128 valid, __m128& u, __m128& v) {
+		__m128 px = _mm_div_ps(x, z);
+		__m128 py = _mm_div_ps(y, z);
+		if (m.distorted) {
+			const float* k = m.coeffs;
+			__m128 r2 = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+			__m128 f = _mm_add_ps(_mm_add_ps(
+				_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(k[0]), r2)),
+				_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(k[1]), r2), r2)),
+				_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(k[4]), r2), r2), r2));
+			px = _mm_mul_ps(px, f);
+			py = _mm_mul_ps(py, f);
+			__m128 two = _mm_set1_ps(2.0f);
+			__m128 dx = _mm_add_ps(
+				_mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2 * k[2]), px), py)),
+				_mm_mul_ps(_mm_set1_ps(k[3]), _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, px), px))));
+			__m128 dy = _mm_add_ps(
+				_mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2 * k[3]), px), py)),
+				_mm_mul_ps(_mm_set1_ps(k[2]), _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, py), py))));
+			px = dx;
+			py = dy;
+		}
+		__m128 pu = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(m.fx)), _mm_set1_ps(m.ppx));
+		__m128 pv = _mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(m.fy)), _mm_set1_ps(m.ppy));
+
+		__m128 inside = _mm_and_ps(valid, _mm_cmpgt_ps(z, _mm_setzero_ps()));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(pu, _mm_set1_ps(m.minU)), _mm_cmplt_ps(pu, _mm_set1_ps(m.maxU))));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(pv, _mm_set1_ps(m.minV)), _mm_cmplt_ps(pv, _mm_set1_ps(m.maxV))));
+		__m128 outside = _mm_andnot_ps(inside, _mm_set1_ps(-1.0f));
+		u = _mm_or_ps(_mm_and_ps(inside, pu), outside);
+		v = _mm_or_ps(_mm_and_ps(inside, pv), outside);
+	}
+
+	RSW_TARGET("sse2") static void deprojectSse2(const Model& m, const uint16_t* depth, const PointCloud& out,
+		size_t begin, size_t end) {
+		const __m128 scale = _mm_set1_ps(m.depthScale);
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + i)), zero);
+			__m128 z = _mm_mul_ps(_mm_cvtepi32_ps(d), scale);
+			__m128 x = _mm_mul_ps(z, _mm_loadu_ps(&m.rayX[i]));
+			__m128 y = _mm_mul_ps(z, _mm_loadu_ps(&m.rayY[i]));
+			if (m.registered) {
+				__m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(d, zero));
+				transformSse2(m, x, y, z);
+				if (out.u != nullptr) {
+					__m128 u;
+					__m128 v;
+					projectSse2(m, x, y, z, valid, u, v);
+					_mm_storeu_ps(out.u + i, u);
+					_mm_storeu_ps(out.v + i, v);
+				}
+				x = _mm_and_ps(valid, x);
+				y = _mm_and_ps(valid, y);
+				z = _mm_and_ps(valid, z);
+			}
+			_mm_storeu_ps(out.x + i, x);
+			_mm_storeu_ps(out.y + i, y);
+			_mm_storeu_ps(out.z + i, z);
+		}
+		deprojectScalar(m, depth, out, i, end);
+	}
+
+	RSW_TARGET("avx2") static inline void transformAvx2(const Model& m, __m256& x, __m256& y, __m256& z) {
+		__m256 to[3];
+		for (int r = 0; r < 3; ++r) {
+			to[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_set1_ps(m.rotation[r]), x),
+				_mm256_mul_ps(_mm256_set1_ps(m.rotation[3 + r]), y)),
+				_mm256_mul_ps(_mm256_set1_ps(m.rotation[6 + r]), z)),
+				_mm256_set1_ps(m.translation[r]));
+		}
+		x = to[0];
+		y = to[1];
+		z = to[2];
+	}
+
+	RSW_TARGET("avx2") static inline void projectAvx2(const Model& m, __m256 x, __m256 y, __m256 z,
+		__m256 valid, __m256& u, __m256& v) {
+		__m256 px = _mm256_div_ps(x, z);
+		__m256 py = _mm256_div_ps(y, z);
+		if (m.distorted) {
+			const float* k = m.coeffs;
+			__m256 r2 = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+			__m256 f = _mm256_add_ps(_mm256_add_ps(
+				_mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(k[0]), r2)),
+				_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(k[1]), r2), r2)),
+				_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(k[4]), r2), r2), r2));
+			px = _mm256_mul_ps(px, f);
+			py = _mm256_mul_ps(py, f);
+			__m256 two = _mm256_set1_ps(2.0f);
+			__m256 dx = _mm256_add_ps(
+				_mm256_add_ps(px, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2 * k[2]), px), py)),
+				_mm256_mul_ps(_mm256_set1_ps(k[3]), _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, px), px))));
+			__m256 dy = _mm256_add_ps(
+				_mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2 * k[3]), px), py)),
+				_mm256_mul_ps(_mm256_set1_ps(k[2]), _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, py), py))));
+			px = dx;
+			py = dy;
+		}
+		__m256 pu = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(m.fx)), _mm256_set1_ps(m.ppx));
+		__m256 pv = _mm256_add_ps(_mm256_mul_ps(py, _mm256_set1_ps(m.fy)), _mm256_set1_ps(m.ppy));
+
+		__m256 inside = _mm256_and_ps(valid, _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_GT_OQ));
+		inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(pu, _mm256_set1_ps(m.minU), _CMP_GE_OQ),
+			_mm256_cmp_ps(pu, _mm256_set1_ps(m.maxU), _CMP_LT_OQ)));
+		inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(pv, _mm256_set1_ps(m.minV), _CMP_GE_OQ),
+			_mm256_cmp_ps(pv, _mm256_set1_ps(m.maxV), _CMP_LT_OQ)));
+		__m256 outside = _mm256_set1_ps(-1.0f);
+		u = _mm256_blendv_ps(outside, pu, inside);
+		v = _mm256_blendv_ps(outside, pv, inside);
+	}
+
+	RSW_TARGET("avx2") static void deprojectAvx2(const Model& m, const uint16_t* depth, const PointCloud& out,
+		size_t begin, size_t end) {
+		const __m256 scale = _mm256_set1_ps(m.depthScale);
+		const __m256i zero = _mm256_setzero_si256();
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			__m256i d = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i)));
+			__m256 z = _mm256_mul_ps(_mm256_cvtepi32_ps(d), scale);
+			__m256 x = _mm256_mul_ps(z, _mm256_loadu_ps(&m.rayX[i]));
+			__m256 y = _mm256_mul_ps(z, _mm256_loadu_ps(&m.rayY[i]));
+			if (m.registered) {
+				__m256 valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(d, zero));
+				transformAvx2(m, x, y, z);
+				if (out.u != nullptr) {
+					__m256 u;
+					__m256 v;
+					projectAvx2(m, x, y, z, valid, u, v);
+					_mm256_storeu_ps(out.u + i, u);
+					_mm256_storeu_ps(out.v + i, v);
+				}
+				x = _mm256_and_ps(valid, x);
+				y = _mm256_and_ps(valid, y);
+				z = _mm256_and_ps(valid, z);
+			}
+			_mm256_storeu_ps(out.x + i, x);
+			_mm256_storeu_ps(out.y + i, y);
+			_mm256_storeu_ps(out.z + i, z);
+		}
+		deprojectScalar(m, depth, out, i, end);
+	}
+#endif
+
+	static void deproject(const Model& m, const uint16_t* depth, const PointCloud& out, size_t begin, size_t end) {
+#ifdef RSW_X86
+		SimdLevel level = getSimdLevel();
+		if (level >= SIMD_AVX2) {
+			deprojectAvx2(m, depth, out, begin, end);
+			return;
+		}
+		if (level >= SIMD_SSE2) {
+			deprojectSse2(m, depth, out, begin, end);
+			return;
+		}
+#endif
+		deprojectScalar(m, depth, out, begin, end);
+	}
+
+	PointCloudGenerator::PointCloudGenerator(const StreamCalibration& depth, int threads) :
+											 _width(0), _height(0), _registered(false), _model(nullptr),
+											 _scratch(), _workers(), _tileRows(0), _tileCount(0), _depth(nullptr),
+											 _cloud(), _nextTile(0), _remaining(0), _generation(0), _shutdown(false) {
+		init(depth, nullptr, threads);
+	}
+
+	PointCloudGenerator::PointCloudGenerator(const StreamCalibration& depth, const StreamCalibration& color,
+											 int threads) :
+											 _width(0), _height(0), _registered(true), _model(nullptr),
+											 _scratch(), _workers(), _tileRows(0), _tileCount(0), _depth(nullptr),
+											 _cloud(), _nextTile(0), _remaining(0), _generation(0), _shutdown(false) {
+		init(depth, &color, threads);
+	}
+
+	PointCloudGenerator::~PointCloudGenerator() {
+		_workM.lock();
+		_shutdown = true;
+		_workM.unlock();
+		_workCv.notify_all();
+		for (auto worker : _workers) {
+			worker->join();
+			delete worker;
+		}
+		delete _model;
+	}
+
+	void PointCloudGenerator::init(const StreamCalibration& depth, const StreamCalibration* color, int threads) {
+		const rs_intrinsics& in = depth.intrinsics;
+		_width = std::max(in.width, 0);
+		_height = std::max(in.height, 0);
+		_model = new Model();
+		Model& m = *_model;
+		m.depthScale = depth.depthScale;
+		m.registered = _registered;
+
+		// Undistortion only depends on the pixel, so it is done here once instead of per frame,
+		// the same way as rs_deproject_pixel_to_point
+		m.rayX.resize(getPointCount());
+		m.rayY.resize(getPointCount());
+		const float* k = in.coeffs;
+		for (int y = 0; y < _height; ++y) {
+			for (int x = 0; x < _width; ++x) {
+				float px = ((float)x - in.ppx) / in.fx;
+				float py = ((float)y - in.ppy) / in.fy;
+				if (in.model == RS_DISTORTION_INVERSE_BROWN_CONRADY) {
+					float r2 = px * px + py * py;
+					float f = 1 + k[0] * r2 + k[1] * r2 * r2 + k[4] * r2 * r2 * r2;
+					float ux = px * f + 2 * k[2] * px * py + k[3] * (r2 + 2 * px * px);
+					float uy = py * f + 2 * k[3] * px * py + k[2] * (r2 + 2 * py * py);
+					px = ux;
+					py = uy;
+				}
+				m.rayX[(size_t)y * _width + x] = px;
+				m.rayY[(size_t)y * _width + x] = py;
+			}
+		}
+
+		if (color != nullptr) {
+			// to the depth stream's coordinates first, then from there to the color camera's
+			rs_extrinsics toColor = compose(depth.toDepth, invert(color->toDepth));
+			std::memcpy(m.rotation, toColor.rotation, sizeof(m.rotation));
+			std::memcpy(m.translation, toColor.translation, sizeof(m.translation));
+			const rs_intrinsics& c = color->intrinsics;
+			m.fx = c.fx;
+			m.fy = c.fy;
+			m.ppx = c.ppx;
+			m.ppy = c.ppy;
+			m.distorted = c.model == RS_DISTORTION_MODIFIED_BROWN_CONRADY;
+			std::memcpy(m.coeffs, c.coeffs, sizeof(m.coeffs));
+			m.colorWidth = c.width;
+			m.colorHeight = c.height;
+			// pixel centers are at whole coordinates
+			m.minU = -0.5f;
+			m.maxU = c.width - 0.5f;
+			m.minV = -0.5f;
+			m.maxV = c.height - 0.5f;
+		}
+
+		// a few tiles per thread so a thread that gets descheduled holds up little
+		threads = std::max(threads, 1);
+		_tileRows = std::max(8, (_height + threads * 4 - 1) / (threads * 4));
+		_tileCount = (_height + _tileRows - 1) / _tileRows;
+		for (int i = 1; i < threads; ++i) {
+			_workers.push_back(new std::thread(&PointCloudGenerator::workLoop, this));
+		}
+	}
+
+	void PointCloudGenerator::workLoop() {
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(_workM);
+		while (true) {
+			_workCv.wait(lock, [&] { return _shutdown || _generation != seen; });
+			if (_shutdown) {
+				return;
+			}
+			seen = _generation;
+			lock.unlock();
+			runTiles();
+			lock.lock();
+		}
+	}
+
+	void PointCloudGenerator::runTiles() {
+		// A worker waking up late finds every tile taken, tiles of the next call are only
+		// handed out after _depth and _cloud are set
+		int tile;
+		while ((tile = _nextTile.fetch_add(1)) < _tileCount) {
+			size_t begin = (size_t)tile * _tileRows * _width;
+			size_t end = (size_t)std::min(_height, (tile + 1) * _tileRows) * _width;
+			deproject(*_model, _depth, _cloud, begin, end);
+			if (_remaining.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(_workM);
+				_doneCv.notify_all();
+			}
+		}
+	}
+
+	void PointCloudGenerator::generate(const uint16_t* depth, const PointCloud& cloud) {
+		std::lock_guard<std::mutex> lock(_m);
+		if (_workers.empty()) {
+			deproject(*_model, depth, cloud, 0, getPointCount());
+			return;
+		}
+
+		_depth = depth;
+		_cloud = cloud;
+		_remaining = _tileCount;
+		_nextTile = 0;
+		_workM.lock();
+		++_generation;
+		_workM.unlock();
+		_workCv.notify_all();
+
+		runTiles();
+		std::unique_lock<std::mutex> done(_workM);
+		_doneCv.wait(done, [this] { return _remaining == 0; });
+	}
+
+	bool PointCloudGenerator::alignToColor(const uint16_t* depth, uint16_t* aligned) {
+		if (!_registered) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(_alignM);
+		size_t n = getPointCount();
+		_scratch.resize(n * 5);
+		PointCloud cloud = { &_scratch[0], &_scratch[n], &_scratch[2 * n], &_scratch[3 * n], &_scratch[4 * n] };
+		generate(depth, cloud);
+
+		const Model& m = *_model;
+		std::fill(aligned, aligned + (size_t)m.colorWidth * m.colorHeight, 0);
+		float units = 1.0f / m.depthScale;
+		for (size_t i = 0; i < n; ++i) {
+			if (cloud.u[i] < m.minU) {
+				continue;
+			}
+			// rounding can carry the last half pixel over the edge
+			int u = std::min((int)(cloud.u[i] + 0.5f), m.colorWidth - 1);
+			int v = std::min((int)(cloud.v[i] + 0.5f), m.colorHeight - 1);
+			float d = cloud.z[i] * units + 0.5f;
+			uint16_t value = d >= 65535.0f ? 65535 : d < 1.0f ? 1 : (uint16_t)d;
+			uint16_t& target = aligned[(size_t)v * m.colorWidth + u];
+			if (target == 0 || value < target) {
+				target = value;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef RSPOINTCLOUD_H
+#define RSPOINTCLOUD_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <rs.hpp>
+
+#include "rs_recording.h"
+
+namespace rsw {
+	const int DEFAULT_POINTCLOUD_THREADS = 4;
+
+	/// Caller owned point cloud in structure of arrays layout, every array holds one value per
+	/// depth pixel in row order. Coordinates are in meters, pixels without depth give (0, 0, 0).
+	struct PointCloud {
+		float* x;
+		float* y;
+		float* z;
+		// optional, the color pixel each point falls on when registered to a color stream,
+		// -1 for points without depth or outside the color image
+		float* u;
+		float* v;
+	};
+
+	/// Turns whole Z16 frames into point clouds. The ray through every depth pixel, with any
+	/// inverse Brown-Conrady distortion removed, is computed once up front, so a frame costs a
+	/// multiply per coordinate. Rows are split into tiles shared by the calling thread and
+	/// threads - 1 workers, and each tile runs the widest kernel getSimdLevel() allows. Every
+	/// level gives the same result as the scalar code.
+	class PointCloudGenerator {
+	public:
+		/// Points are in the depth camera's coordinates. Depth streams with forward distortion
+		/// cannot be undistorted and are taken as rectilinear.
+		PointCloudGenerator(const StreamCalibration& depth, int threads = 1);
+		/// Points are in the color camera's coordinates and are projected into the color image.
+		/// Color streams with inverse distortion are projected without it.
+		PointCloudGenerator(const StreamCalibration& depth, const StreamCalibration& color, int threads = 1);
+		~PointCloudGenerator();
+
+		int getWidth() const { return _width; }
+		int getHeight() const { return _height; }
+		size_t getPointCount() const { return (size_t)_width * _height; }
+		bool isRegistered() const { return _registered; }
+
+		/// Fills cloud with the points of a depth frame of the calibrated size. u and v are
+		/// only written if registered and not nullptr. Concurrent calls take turns.
+		void generate(const uint16_t* depth, const PointCloud& cloud);
+
+		/// Depth as seen from the color camera, in depth units on the color image grid. Where
+		/// several points fall on a pixel the nearest wins, pixels no point falls on are 0.
+		/// aligned must hold the color stream's width * height values. Returns false if not
+		/// registered.
+		bool alignToColor(const uint16_t* depth, uint16_t* aligned);
+
+		// ray tables and camera parameters, used by the kernels in the .cpp
+		struct Model;
+
+	private:
+		int _width;
+		int _height;
+		bool _registered;
+		Model* _model;
+		// serializes generate, and alignToColor's use of the scratch cloud
+		std::mutex _m;
+		std::mutex _alignM;
+		std::vector<float> _scratch;
+
+		// work of the current generate call, tiles are claimed through _nextTile
+		std::vector<std::thread*> _workers;
+		int _tileRows;
+		int _tileCount;
+		const uint16_t* _depth;
+		PointCloud _cloud;
+		std::atomic<int> _nextTile;
+		std::atomic<int> _remaining;
+		uint64_t _generation;
+		bool _shutdown;
+		std::mutex _workM;
+		std::condition_variable _workCv;
+		std::condition_variable _doneCv;
+
+		void init(const StreamCalibration& depth, const StreamCalibration* color, int threads);
+		void workLoop();
+		void runTiles();
+
+		PointCloudGenerator(const PointCloudGenerator&);
+		PointCloudGenerator& operator=(const PointCloudGenerator&);
+	};
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ios>
+
+#include "rs_log.h"
+#include "rs_recording.h"
+
+namespace rsw {
+	fs::path segmentPath(const fs::path& dir, int n) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "seg_%06d.rsseg", n);
+		return dir / name;
+	}
+
+	fs::path segmentIndexPath(const fs::path& dir, int n) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "seg_%06d.rsidx", n);
+		return dir / name;
+	}
+
+	bool isSegmentedRecording(const fs::path& dir) {
+		return fs::exists(segmentIndexPath(dir, 0));
+	}
+
+	fs::path calibrationPath(const fs::path& dir) {
+		return dir / "calibration.rscal";
+	}
+
+	bool writeCalibration(const fs::path& dir, const StreamCalibration& calibration) {
+		const rs_intrinsics& in = calibration.intrinsics;
+		CalibrationRecord record = {};
+		record.magic = CALIBRATION_MAGIC;
+		record.version = CALIBRATION_VERSION;
+		record.width = in.width;
+		record.height = in.height;
+		record.ppx = in.ppx;
+		record.ppy = in.ppy;
+		record.fx = in.fx;
+		record.fy = in.fy;
+		record.model = (int32_t)in.model;
+		std::memcpy(record.coeffs, in.coeffs, sizeof(record.coeffs));
+		std::memcpy(record.rotation, calibration.toDepth.rotation, sizeof(record.rotation));
+		std::memcpy(record.translation, calibration.toDepth.translation, sizeof(record.translation));
+		record.depthScale = calibration.depthScale;
+
+		fs::path p = calibrationPath(dir);
+		fs::path tmp = p;
+		tmp += ".tmp";
+		{
+			fs::ofstream file(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+			if (!file) {
+				return false;
+			}
+		}
+		boost::system::error_code ec;
+		fs::rename(tmp, p, ec);
+		return !ec;
+	}
+
+	bool readCalibration(const fs::path& dir, StreamCalibration& calibration) {
+		CalibrationRecord record;
+		fs::ifstream file(calibrationPath(dir), std::ios::in | std::ios::binary);
+		if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) ||
+				record.magic != CALIBRATION_MAGIC || record.version != CALIBRATION_VERSION) {
+			return false;
+		}
+
+		rs_intrinsics& in = calibration.intrinsics;
+		in.width = record.width;
+		in.height = record.height;
+		in.ppx = record.ppx;
+		in.ppy = record.ppy;
+		in.fx = record.fx;
+		in.fy = record.fy;
+		in.model = (rs_distortion)record.model;
+		std::memcpy(in.coeffs, record.coeffs, sizeof(in.coeffs));
+		std::memcpy(calibration.toDepth.rotation, record.rotation, sizeof(record.rotation));
+		std::memcpy(calibration.toDepth.translation, record.translation, sizeof(record.translation));
+		calibration.depthScale = record.depthScale;
+		return true;
+	}
+
+	SegmentWriter::SegmentWriter(fs::path dir, uint64_t maxSegmentSize, WriteOptions options) :
+								 _dir(dir), _maxSegmentSize(maxSegmentSize), _options(options),
+								 _segment(-1), _offset(0), _frameCount(0), _timestamps(dir), _data(), _index(),
+								 _unsynced(0), _lastSync(std::chrono::steady_clock::now()),
+								 _headers(), _buffers(), _entries() {
+		// Continue after any segments already present in the folder
+		int n = 0;
+		while (fs::exists(segmentIndexPath(_dir, n))) {
+			++n;
+		}
+		openSegment(n);
+	}
+
+	SegmentWriter::~SegmentWriter() {
+		close();
+	}
+
+	void SegmentWriter::openSegment(int n) {
+		closeSegment();
+		_segment = n;
+		_offset = 0;
+		_data.open(segmentPath(_dir, n), _maxSegmentSize, _options);
+		_index.open(segmentIndexPath(_dir, n), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!_index) {
+			throw fs::filesystem_error("Unable to create segment", segmentPath(_dir, n),
+				boost::system::errc::make_error_code(boost::system::errc::io_error));
+		}
+	}
+
+	void SegmentWriter::closeSegment() {
+		if (_unsynced > 0 && (_options.syncIntervalMs > 0 || _options.syncBytes > 0)) {
+			_data.sync();
+			_unsynced = 0;
+		}
+		_data.close();
+		_index.close();
+	}
+
+	void SegmentWriter::syncIfDue(uint64_t bytes) {
+		_unsynced += bytes;
+		if (_unsynced == 0) {
+			return;
+		}
+		auto now = std::chrono::steady_clock::now();
+		if ((_options.syncBytes > 0 && _unsynced >= _options.syncBytes) ||
+				(_options.syncIntervalMs > 0 && now - _lastSync >= std::chrono::milliseconds(_options.syncIntervalMs))) {
+			_data.sync();
+			_unsynced = 0;
+			_lastSync = now;
+		}
+	}
+
+	std::chrono::steady_clock::time_point SegmentWriter::getSyncDeadline() const {
+		if (_options.syncIntervalMs <= 0 || _unsynced == 0) {
+			return std::chrono::steady_clock::time_point::max();
+		}
+		return _lastSync + std::chrono::milliseconds(_options.syncIntervalMs);
+	}
+
+	bool SegmentWriter::append(int timestamp, rs::stream strm, rs::format fmt,
+			int width, int height, const char* data, uint32_t size, uint32_t flags) {
+		SegmentRecord record = { timestamp, strm, fmt, width, height, data, size, flags };
+		return append(&record, 1) == 1;
+	}
+
+	size_t SegmentWriter::append(const SegmentRecord* records, size_t count) {
+		size_t done = 0;
+		while (done < count) {
+			// take as many records as fit into the current segment, a full segment is only
+			// rolled over once it holds at least one frame
+			size_t n = 0;
+			uint64_t bytes = 0;
+			while (done + n < count) {
+				uint64_t recordSize = sizeof(FrameRecordHeader) + records[done + n].size;
+				if (_offset + bytes > 0 && _offset + bytes + recordSize > _maxSegmentSize) {
+					break;
+				}
+				bytes += recordSize;
+				++n;
+			}
+			if (n == 0) {
+				try {
+					openSegment(_segment + 1);
+				} catch (const fs::filesystem_error& e) {
+					RSW_LOG(LOG_ERROR, e.what());
+					return done;
+				}
+				continue;
+			}
+
+			_headers.resize(n);
+			_buffers.resize(2 * n);
+			_entries.resize(n);
+			uint64_t offset = _offset;
+			for (size_t i = 0; i < n; ++i) {
+				const SegmentRecord& r = records[done + i];
+				_headers[i] = { FRAME_RECORD_MAGIC, r.timestamp, (int32_t)r.stream,
+					(int32_t)r.format, r.width, r.height, r.size, r.flags };
+				_buffers[2 * i] = { reinterpret_cast<const char*>(&_headers[i]), sizeof(FrameRecordHeader) };
+				_buffers[2 * i + 1] = { r.data, r.size };
+				_entries[i] = { r.timestamp, r.size, offset };
+				offset += sizeof(FrameRecordHeader) + r.size;
+			}
+			if (!_data.append(_buffers.data(), _buffers.size())) {
+				return done;
+			}
+			syncIfDue(bytes);
+
+			_index.write(reinterpret_cast<const char*>(_entries.data()), n * sizeof(SegmentIndexEntry));
+			_index.flush();
+			bool indexed = true;
+			for (auto& e : _entries) {
+				indexed = _timestamps.append(e.timestamp, _segment, e.offset, e.size) && indexed;
+			}
+			indexed = _timestamps.flush() && indexed;
+
+			// the payload is on disk, so the frames count as written whether or not indexing them worked
+			_offset += bytes;
+			_frameCount += (int)n;
+			done += n;
+			if (!indexed) {
+				RSW_LOG(LOG_ERROR, "Unable to add " << n << " frames to the timestamp index of " << _dir <<
+					", rebuilding the index recovers them from the segment indices");
+			}
+			if (!_index) {
+				RSW_LOG(LOG_ERROR, "Unable to index " << n << " frames in segment " << _segment << " of " << _dir <<
+					", they are on disk but not found by readers");
+				// later frames go to a new segment with an index that can be written
+				try {
+					openSegment(_segment + 1);
+				} catch (const fs::filesystem_error& e) {
+					RSW_LOG(LOG_ERROR, e.what());
+					return done;
+				}
+			}
+		}
+		return done;
+	}
+
+	void SegmentWriter::close() {
+		closeSegment();
+		_timestamps.close();
+	}
+
+	RecordingReader::RecordingReader(fs::path dir) : _dir(dir), _index(dir), _maps() {
+	}
+
+	void RecordingReader::refresh() {
+		_index.refresh();
+	}
+
+	bool RecordingReader::read(int timestamp, std::vector<char>& out, TimestampIndex::SeekMode mode) {
+		FrameHandle frame;
+		if (!map(timestamp, frame, mode)) {
+			return false;
+		}
+		out.assign(frame.data(), frame.data() + frame.size());
+		return true;
+	}
+
+	bool RecordingReader::map(int timestamp, FrameHandle& out, TimestampIndex::SeekMode mode) {
+		const TimestampIndexEntry* e = _index.seek(timestamp, mode);
+		return e != nullptr && mapEntry(*e, out);
+	}
+
+	bool RecordingReader::mapEntry(const TimestampIndexEntry& e, FrameHandle& out) {
+		namespace bip = boost::interprocess;
+
+		if (e.segment < 0) {
+			// one file per frame, these carry no image metadata
+			if (e.size == 0) {
+				return false;
+			}
+			std::shared_ptr<bip::mapped_region> region;
+			try {
+				bip::file_mapping file((_dir / std::to_string(e.timestamp)).string().c_str(), bip::read_only);
+				region = std::make_shared<bip::mapped_region>(file, bip::read_only);
+			} catch (const bip::interprocess_exception&) {
+				return false;
+			}
+			out = FrameHandle(region, static_cast<const char*>(region->get_address()),
+				region->get_size(), 0, 0, rs::format::any, e.timestamp);
+			return true;
+		}
+
+		if ((int)_maps.size() <= e.segment) {
+			_maps.resize(e.segment + 1);
+		}
+		// The segment being written keeps growing, remap it once a frame lies past the mapped end
+		auto& region = _maps[e.segment];
+		uint64_t end = e.offset + sizeof(FrameRecordHeader) + e.size;
+		if (!region || region->get_size() < end) {
+			try {
+				bip::file_mapping file(segmentPath(_dir, e.segment).string().c_str(), bip::read_only);
+				region = std::make_shared<bip::mapped_region>(file, bip::read_only);
+			} catch (const bip::interprocess_exception&) {
+				return false;
+			}
+			if (region->get_size() < end) {
+				return false;
+			}
+		}
+
+		const char* base = static_cast<const char*>(region->get_address()) + e.offset;
+		FrameRecordHeader h;
+		std::memcpy(&h, base, sizeof(h));
+		if (h.magic != FRAME_RECORD_MAGIC) {
+			return false;
+		}
+		uint32_t codecId = h.flags & CODEC_FLAG_MASK;
+		if (codecId == CODEC_NONE) {
+			out = FrameHandle(region, base + sizeof(h), h.size, h.width, h.height,
+				(rs::format)h.format, h.timestamp);
+			return true;
+		}
+
+		FrameCodec* codec = getCodec(codecId);
+		int rawSize = getImgSize(h.width, h.height, (rs_format)h.format);
+		if (codec == nullptr || rawSize <= 0) {
+			return false;
+		}
+		auto raw = std::make_shared<std::vector<char>>(rawSize);
+		if (!codec->decode(base + sizeof(h), h.size, h.width, h.height, raw->data(), raw->size())) {
+			return false;
+		}
+		out = FrameHandle(raw, raw->data(), raw->size(), h.width, h.height,
+			(rs::format)h.format, h.timestamp);
+		return true;
+	}
+
+	int RecordingReader::latestTimestamp() const {
+		return _index.size() == 0 ? -1 : (_index.end() - 1)->timestamp;
+	}
+}
@@ -0,0 +1,185 @@
+#ifndef RSRECORDING_H
+#define RSRECORDING_H
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <rs.hpp>
+
+#include "rs_compress.h"
+#include "rs_frame_handle.h"
+#include "rs_segment_file.h"
+#include "rs_timestamp_index.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	const uint32_t FRAME_RECORD_MAGIC = 0x31575352; // "RSW1"
+	const uint64_t DEFAULT_SEGMENT_SIZE = 256ull * 1024 * 1024;
+	const uint32_t CALIBRATION_MAGIC = 0x43575352; // "RSWC"
+	const uint32_t CALIBRATION_VERSION = 1;
+
+#pragma pack(push, 1)
+	/// Header written in front of every frame payload inside a segment file
+	struct FrameRecordHeader {
+		uint32_t magic;
+		int32_t timestamp;
+		int32_t stream;
+		int32_t format;
+		int32_t width;
+		int32_t height;
+		uint32_t size;  // payload bytes following this header
+		uint32_t flags; // low byte is the CodecId of the payload, other bits reserved
+	};
+
+	/// One entry of a per-segment timestamp index, points at the FrameRecordHeader
+	struct SegmentIndexEntry {
+		int32_t timestamp;
+		uint32_t size;
+		uint64_t offset;
+	};
+
+	/// Contents of a recording's calibration file
+	struct CalibrationRecord {
+		uint32_t magic;
+		uint32_t version;
+		int32_t width;
+		int32_t height;
+		float ppx;
+		float ppy;
+		float fx;
+		float fy;
+		int32_t model; // rs_distortion
+		float coeffs[5];
+		float rotation[9];
+		float translation[3];
+		float depthScale;
+	};
+#pragma pack(pop)
+
+	/// Camera model of a recorded stream, taken from the device when the stream is configured
+	struct StreamCalibration {
+		rs_intrinsics intrinsics;
+		// from this stream's coordinates to the depth stream's of the same device
+		rs_extrinsics toDepth;
+		// meters per unit of the device's Z16 depth
+		float depthScale;
+	};
+
+	/// One frame of a batch passed to SegmentWriter::append
+	struct SegmentRecord {
+		int timestamp;
+		rs::stream stream;
+		rs::format format;
+		int width;
+		int height;
+		const char* data;
+		uint32_t size;
+		uint32_t flags;
+	};
+
+	/// Returns path of segment file number n inside a recording folder
+	fs::path segmentPath(const fs::path& dir, int n);
+	/// Returns path of the timestamp index belonging to segment number n
+	fs::path segmentIndexPath(const fs::path& dir, int n);
+	/// Returns true if the recording folder uses the segmented layout rather than
+	/// one file per frame
+	bool isSegmentedRecording(const fs::path& dir);
+	/// Returns path of the calibration file inside a recording folder
+	fs::path calibrationPath(const fs::path& dir);
+	/// Replaces the calibration file of a recording, readers never see a partial one.
+	/// Returns false if unable to write it.
+	bool writeCalibration(const fs::path& dir, const StreamCalibration& calibration);
+	/// Returns false if the recording has no valid calibration file
+	bool readCalibration(const fs::path& dir, StreamCalibration& calibration);
+
+	/// Appends frames of a single stream to a sequence of large segment files.
+	/// Every segment gets a compact index file of (timestamp, offset, size) entries, and
+	/// the recording's timestamp index is extended as frames are written.
+	/// Data is written (and synced, if the WriteOptions ask for it) before its index entries
+	/// so readers never see an entry whose payload is incomplete.
+	class SegmentWriter {
+	public:
+		/// throws boost::filesystem::filesystem_error if unable to create segment files
+		SegmentWriter(fs::path dir, uint64_t maxSegmentSize = DEFAULT_SEGMENT_SIZE,
+			WriteOptions options = WriteOptions());
+		~SegmentWriter();
+
+		/// flags go into the FrameRecordHeader, see CodecId
+		bool append(int timestamp, rs::stream strm, rs::format fmt, int width, int height,
+			const char* data, uint32_t size, uint32_t flags = CODEC_NONE);
+		/// Writes the records in order, with one write per segment they fall into.
+		/// Returns how many were written, the rest failed. Frames whose payload is written
+		/// count as written even if indexing them failed, which is logged.
+		size_t append(const SegmentRecord* records, size_t count);
+		void close();
+		/// Syncs the data appended since the last sync if syncIntervalMs has passed, for a
+		/// writer that went idle and would otherwise only sync on its next append
+		void syncIfDue() { syncIfDue(0); }
+		/// When syncIfDue next has data to sync, time_point::max() if it has none
+		std::chrono::steady_clock::time_point getSyncDeadline() const;
+
+		int getFrameCount() const { return _frameCount; }
+
+	private:
+		fs::path _dir;
+		uint64_t _maxSegmentSize;
+		WriteOptions _options;
+		int _segment;
+		uint64_t _offset;
+		int _frameCount;
+		TimestampIndexWriter _timestamps;
+		SegmentFile _data;
+		fs::ofstream _index;
+		// data written since the last sync
+		uint64_t _unsynced;
+		std::chrono::steady_clock::time_point _lastSync;
+		// reused by every batch
+		std::vector<FrameRecordHeader> _headers;
+		std::vector<WriteBuffer> _buffers;
+		std::vector<SegmentIndexEntry> _entries;
+
+		void openSegment(int n);
+		void closeSegment();
+		void syncIfDue(uint64_t bytes);
+	};
+
+	/// Random access reader over a single recording, segmented or one file per frame.
+	/// Lookups go through the memory mapped timestamp index of the recording.
+	class RecordingReader {
+	public:
+		RecordingReader(fs::path dir);
+
+		/// Picks up frames appended since the last call
+		void refresh();
+
+		/// Returns false if no frame matches timestamp under the given seek mode
+		bool read(int timestamp, std::vector<char>& out,
+			TimestampIndex::SeekMode mode = TimestampIndex::EXACT);
+		/// Same as read, but returns a handle pointing into the memory mapped frame.
+		/// Compressed frames are decoded into a buffer owned by the handle instead.
+		bool map(int timestamp, FrameHandle& out,
+			TimestampIndex::SeekMode mode = TimestampIndex::EXACT);
+		/// Returns latest recorded timestamp, or -1 if the recording is empty
+		int latestTimestamp() const;
+		size_t getFrameCount() const { return _index.size(); }
+		const TimestampIndex& getIndex() const { return _index; }
+		/// Same as map, for an entry of getIndex()
+		bool mapEntry(const TimestampIndexEntry& e, FrameHandle& out);
+
+	private:
+		fs::path _dir;
+		TimestampIndex _index;
+		// read-only mappings of segments, shared with the handles pointing into them
+		std::vector<std::shared_ptr<boost::interprocess::mapped_region>> _maps;
+	};
+}
+
+#endif
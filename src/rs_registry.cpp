@@ -0,0 +1,24 @@
+#include "rs_registry.h"
+#include "rs_frame_handle.h"
+
+namespace rsw {
+	DeviceState::DeviceState(std::string serial, DeviceSource* source) :
+							 serial(serial), source(source),
+							 name(source == nullptr ? "" : source->getName()),
+							 m(source == nullptr ? nullptr : new std::mutex()),
+							 engine(source == nullptr ? nullptr : new CaptureEngine(source, m)) {
+	}
+
+	DeviceState::~DeviceState() {
+		delete engine;
+		delete m;
+		delete source;
+	}
+
+	StreamState::StreamState(fs::path recording, CaptureEngine::StreamConfig config, size_t ringCapacity,
+							 std::shared_ptr<StreamMetrics> metrics) :
+							 recording(recording), config(config),
+							 imgSize(getImgSize(config.width, config.height, (rs_format)config.format)),
+							 metrics(metrics), ring(ringCapacity), consumer(-1), lastCaptured(-1), lastWritten(-1) {
+	}
+}
@@ -0,0 +1,175 @@
+#ifndef RSREGISTRY_H
+#define RSREGISTRY_H
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+#include <rs.hpp>
+
+#include "rs_capture.h"
+#include "rs_metrics.h"
+#include "rs_frame_ring.h"
+#include "rs_recording.h"
+#include "rs_sync.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	const size_t DEFAULT_SHARD_COUNT = 16;
+
+	struct PathHash {
+		size_t operator()(const fs::path& p) const { return std::hash<std::string>()(p.string()); }
+	};
+
+	/// Map split into shards that are each published as an immutable snapshot. Lookups load
+	/// the current snapshot of one shard atomically and never wait for writers, writers copy
+	/// the shard, change the copy and publish it, serialized only against writers of the
+	/// same shard. Meant for maps that are read on every frame and change rarely.
+	template <typename K, typename V, typename Hash = std::hash<K>>
+	class ShardedMap {
+	public:
+		typedef std::map<K, std::shared_ptr<V>> Shard;
+
+		ShardedMap(size_t shardCount = DEFAULT_SHARD_COUNT) : _shards(shardCount) {
+			for (auto& shard : _shards) {
+				shard.snapshot = std::make_shared<const Shard>();
+			}
+		}
+
+		/// Returns nullptr if key is not present
+		std::shared_ptr<V> find(const K& key) const {
+			auto snapshot = std::atomic_load(&shardFor(key).snapshot);
+			auto it = snapshot->find(key);
+			return it == snapshot->end() ? nullptr : it->second;
+		}
+
+		/// Adds value unless key is present already. Returns the value stored under key
+		/// afterwards, which is not value if another one was there first.
+		std::shared_ptr<V> insert(const K& key, std::shared_ptr<V> value) {
+			std::shared_ptr<V> stored;
+			update(key, [&](Shard& shard) {
+				stored = shard.emplace(key, value).first->second;
+			});
+			return stored;
+		}
+
+		/// Adds or replaces the value of key
+		void assign(const K& key, std::shared_ptr<V> value) {
+			update(key, [&](Shard& shard) {
+				shard[key] = value;
+			});
+		}
+
+		/// Returns the removed value, or nullptr if key was not present
+		std::shared_ptr<V> erase(const K& key) {
+			std::shared_ptr<V> removed;
+			update(key, [&](Shard& shard) {
+				auto it = shard.find(key);
+				if (it != shard.end()) {
+					removed = it->second;
+					shard.erase(it);
+				}
+			});
+			return removed;
+		}
+
+		void clear() {
+			for (auto& shard : _shards) {
+				std::lock_guard<std::mutex> lock(shard.writeM);
+				std::atomic_store(&shard.snapshot, std::make_shared<const Shard>());
+			}
+		}
+
+		/// Calls f for every entry, each shard as it was when the call reached it
+		void forEach(std::function<void(const K&, const std::shared_ptr<V>&)> f) const {
+			for (auto& shard : _shards) {
+				auto snapshot = std::atomic_load(&shard.snapshot);
+				for (auto& entry : *snapshot) {
+					f(entry.first, entry.second);
+				}
+			}
+		}
+
+	private:
+		struct Slot {
+			std::mutex writeM;
+			std::shared_ptr<const Shard> snapshot;
+		};
+
+		mutable std::vector<Slot> _shards;
+
+		Slot& shardFor(const K& key) const {
+			return _shards[Hash()(key) % _shards.size()];
+		}
+
+		void update(const K& key, std::function<void(Shard&)> change) {
+			Slot& shard = shardFor(key);
+			std::lock_guard<std::mutex> lock(shard.writeM);
+			auto next = std::make_shared<Shard>(*shard.snapshot);
+			change(*next);
+			std::atomic_store(&shard.snapshot, std::shared_ptr<const Shard>(std::move(next)));
+		}
+	};
+
+	/// A device found at startup or known from recordings. Nothing but the capture engine
+	/// changes after construction, so the registry hands it out without locking.
+	struct DeviceState {
+		/// source is nullptr if the device is not connected, takes ownership of source
+		DeviceState(std::string serial, DeviceSource* source);
+		/// Stops the capture thread
+		~DeviceState();
+
+		const std::string serial;
+		DeviceSource* const source;
+		// read once, so status queries never wait for the capture thread
+		const std::string name;
+		// guards all other access to the device, held by the capture thread while reading frames
+		std::mutex* const m;
+		CaptureEngine* const engine;
+
+	private:
+		DeviceState(const DeviceState&);
+		DeviceState& operator=(const DeviceState&);
+	};
+
+	/// A stream being recorded. Only the capture thread of its device pushes to the ring,
+	/// and the timestamp counters are updated without locking.
+	struct StreamState {
+		StreamState(fs::path recording, CaptureEngine::StreamConfig config, size_t ringCapacity,
+			std::shared_ptr<StreamMetrics> metrics);
+
+		const fs::path recording;
+		const CaptureEngine::StreamConfig config;
+		const int imgSize;
+		// updated by the capture and writer threads, kept by the registry after the stream stops
+		const std::shared_ptr<StreamMetrics> metrics;
+		// recent frames, shared with the disk writer
+		FrameRing ring;
+		// -1 until the capture consumer is registered
+		std::atomic<int> consumer;
+		// latest captured and latest written timestamps, -1 before the first frame
+		std::atomic<int> lastCaptured;
+		std::atomic<int> lastWritten;
+	};
+
+	/// A recording opened for reading, lookups on one recording are serialized
+	struct ReaderState {
+		ReaderState(fs::path recording) : m(), reader(recording) {}
+
+		std::mutex m;
+		RecordingReader reader;
+	};
+
+	/// Sync groups a recording's frames are handed to, with the recording's member index
+	typedef std::vector<std::pair<std::shared_ptr<FrameSynchronizer>, size_t>> SyncTargets;
+}
+
+#endif
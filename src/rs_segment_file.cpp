@@ -0,0 +1,223 @@
+#ifndef _WIN32
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "rs_log.h"
+#include "rs_segment_file.h"
+
+namespace rsw {
+#ifndef _WIN32
+	// Writes all of the iovecs at offset, continuing after partial writes. With an alignment,
+	// as O_DIRECT needs, offset and buffers are aligned and a partial write continues at the
+	// start of the block it ended in. A write that does not complete a single block fails,
+	// retrying it would make no progress.
+	static bool writeAll(int fd, struct iovec* iov, int count, uint64_t offset, size_t alignment = 1) {
+		while (count > 0) {
+			ssize_t n = pwritev(fd, iov, std::min(count, IOV_MAX), (off_t)offset);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			n -= n % alignment;
+			if (n == 0) {
+				return false;
+			}
+			offset += n;
+			while (count > 0 && (size_t)n >= iov->iov_len) {
+				n -= iov->iov_len;
+				++iov;
+				--count;
+			}
+			if (count > 0) {
+				iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+				iov->iov_len -= n;
+			}
+		}
+		return true;
+	}
+#endif
+
+	SegmentFile::SegmentFile() :
+#ifdef _WIN32
+								 _file(nullptr),
+#else
+								 _fd(-1),
+#endif
+								 _direct(false), _size(0), _staging(nullptr), _stagingCapacity(0) {
+	}
+
+	SegmentFile::~SegmentFile() {
+		close();
+		std::free(_staging);
+	}
+
+	bool SegmentFile::isOpen() const {
+#ifdef _WIN32
+		return _file != nullptr;
+#else
+		return _fd >= 0;
+#endif
+	}
+
+	void SegmentFile::open(const fs::path& p, uint64_t reserve, const WriteOptions& options) {
+		close();
+		_size = 0;
+		_direct = false;
+#ifdef _WIN32
+		// no direct I/O or preallocation here, buffered writes only
+		_file = std::fopen(p.string().c_str(), "wb");
+		if (_file == nullptr) {
+			throw fs::filesystem_error("Unable to create segment", p,
+				boost::system::errc::make_error_code(boost::system::errc::io_error));
+		}
+#else
+		int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+		if (options.direct) {
+			_fd = ::open(p.string().c_str(), flags | O_DIRECT, 0644);
+			if (_fd >= 0) {
+				_direct = true;
+			} else if (errno == EINVAL) {
+				RSW_LOG(LOG_WARN, "Direct I/O not supported for " << p << ", using buffered writes");
+			}
+		}
+#endif
+		if (_fd < 0) {
+			_fd = ::open(p.string().c_str(), flags, 0644);
+		}
+		if (_fd < 0) {
+			throw fs::filesystem_error("Unable to create segment", p,
+				boost::system::errc::make_error_code((boost::system::errc::errc_t)errno));
+		}
+#ifdef __linux__
+		// keeps the file size, so readers only ever see written data; failure just means no reservation
+		if (options.preallocate && reserve > 0) {
+			fallocate(_fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)reserve);
+		}
+#endif
+#endif
+	}
+
+	bool SegmentFile::append(const WriteBuffer* buffers, size_t count) {
+		if (!isOpen()) {
+			return false;
+		}
+		if (_direct) {
+			return appendDirect(buffers, count);
+		}
+
+		uint64_t bytes = 0;
+#ifdef _WIN32
+		for (size_t i = 0; i < count; ++i) {
+			if (std::fwrite(buffers[i].data, 1, buffers[i].size, _file) != buffers[i].size) {
+				return false;
+			}
+			bytes += buffers[i].size;
+		}
+		if (std::fflush(_file) != 0) {
+			return false;
+		}
+#else
+		std::vector<struct iovec> iov(count);
+		for (size_t i = 0; i < count; ++i) {
+			iov[i].iov_base = const_cast<char*>(buffers[i].data);
+			iov[i].iov_len = buffers[i].size;
+			bytes += buffers[i].size;
+		}
+		if (!writeAll(_fd, iov.data(), (int)count, _size)) {
+			return false;
+		}
+#endif
+		_size += bytes;
+		return true;
+	}
+
+	bool SegmentFile::appendDirect(const WriteBuffer* buffers, size_t count) {
+#ifdef _WIN32
+		return false;
+#else
+		// the staging buffer starts with the partial block left at the end of the file
+		size_t tail = (size_t)(_size % DIRECT_ALIGNMENT);
+		size_t total = tail;
+		for (size_t i = 0; i < count; ++i) {
+			total += buffers[i].size;
+		}
+		size_t padded = (total + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+		if (padded > _stagingCapacity) {
+			void* staging = nullptr;
+			if (posix_memalign(&staging, DIRECT_ALIGNMENT, padded) != 0) {
+				return false;
+			}
+			if (tail > 0) {
+				std::memcpy(staging, _staging, tail);
+			}
+			std::free(_staging);
+			_staging = static_cast<char*>(staging);
+			_stagingCapacity = padded;
+		}
+
+		char* dst = _staging + tail;
+		for (size_t i = 0; i < count; ++i) {
+			std::memcpy(dst, buffers[i].data, buffers[i].size);
+			dst += buffers[i].size;
+		}
+		std::memset(dst, 0, padded - total);
+
+		struct iovec iov = { _staging, padded };
+		if (!writeAll(_fd, &iov, 1, _size - tail, DIRECT_ALIGNMENT)) {
+			return false;
+		}
+		_size += total - tail;
+
+		// keep the new partial block for the next append
+		size_t full = total / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+		if (full > 0 && total > full) {
+			std::memmove(_staging, _staging + full, total - full);
+		}
+		return true;
+#endif
+	}
+
+	bool SegmentFile::sync() {
+		if (!isOpen()) {
+			return false;
+		}
+#ifdef _WIN32
+		return std::fflush(_file) == 0;
+#elif defined(__linux__)
+		return fdatasync(_fd) == 0;
+#else
+		return fsync(_fd) == 0;
+#endif
+	}
+
+	void SegmentFile::close() {
+		if (!isOpen()) {
+			return;
+		}
+#ifdef _WIN32
+		std::fclose(_file);
+		_file = nullptr;
+#else
+		// cuts off direct I/O padding and any reservation past the data
+		if (ftruncate(_fd, (off_t)_size) != 0) {
+			RSW_LOG(LOG_ERROR, "Unable to trim segment to " << _size << " bytes");
+		}
+		::close(_fd);
+		_fd = -1;
+#endif
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef RSSEGMENTFILE_H
+#define RSSEGMENTFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	/// How segment data reaches the disk
+	struct WriteOptions {
+		// bypass the page cache so recording does not evict what is being analysed,
+		// falls back to buffered writes where the filesystem does not support it
+		bool direct = false;
+		// reserve a whole segment on disk when it is created. Off by default, every stream
+		// would hold a segment's worth of space before writing its first frame.
+		bool preallocate = false;
+		// fsync segment data once this many ms or bytes were written since the last sync,
+		// 0 leaves it to the operating system. The disk writer also syncs a recording that
+		// went idle once its interval has passed.
+		int syncIntervalMs = 0;
+		uint64_t syncBytes = 0;
+	};
+
+	/// A piece of data to append, see SegmentFile::append
+	struct WriteBuffer {
+		const char* data;
+		size_t size;
+	};
+
+	/// Append-only data file of a segment. A list of buffers is written with a single
+	/// vectored write, or with direct I/O copied into an aligned staging buffer first.
+	/// In direct mode the last partial block is written padded and rewritten by the
+	/// next append, the padding is cut off on close.
+	class SegmentFile {
+	public:
+		static const size_t DIRECT_ALIGNMENT = 4096;
+
+		SegmentFile();
+		~SegmentFile();
+
+		/// Creates or truncates the file and reserves reserve bytes for it.
+		/// throws boost::filesystem::filesystem_error if the file cannot be created
+		void open(const fs::path& p, uint64_t reserve, const WriteOptions& options);
+		/// Returns false if not everything could be written
+		bool append(const WriteBuffer* buffers, size_t count);
+		/// Flushes written data to the device
+		bool sync();
+		/// Releases reserved space past the data and closes the file
+		void close();
+
+		bool isOpen() const;
+		uint64_t getSize() const { return _size; }
+		bool isDirect() const { return _direct; }
+
+	private:
+#ifdef _WIN32
+		std::FILE* _file;
+#else
+		int _fd;
+#endif
+		bool _direct;
+		uint64_t _size;
+		char* _staging;
+		size_t _stagingCapacity;
+
+		bool appendDirect(const WriteBuffer* buffers, size_t count);
+	};
+}
+
+#endif
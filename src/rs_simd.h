@@ -0,0 +1,22 @@
+#ifndef RSSIMD_H
+#define RSSIMD_H
+
+// Included by the translation units with SIMD kernels only, see SimdLevel for the dispatch
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RSW_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit instructions beyond the build's baseline inside functions marked
+// for them, MSVC emits any intrinsic
+#if defined(RSW_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RSW_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RSW_TARGET(isa)
+#endif
+
+#endif
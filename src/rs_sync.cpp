@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <ios>
+
+#include "rs_sync.h"
+
+namespace rsw {
+	static const size_t MAX_PENDING = 64;
+
+	ClockModel::ClockModel() : _offsets(), _lastTimestamp(0) {
+	}
+
+	int64_t ClockModel::toHost(int timestamp, int64_t hostTime) {
+		// the device restarted its clock
+		if (!_offsets.empty() && timestamp < _lastTimestamp - 1000) {
+			_offsets.clear();
+		}
+		_lastTimestamp = timestamp;
+
+		_offsets.push_back(hostTime - timestamp);
+		if (_offsets.size() > CLOCK_WINDOW) {
+			_offsets.pop_front();
+		}
+		return timestamp + *std::min_element(_offsets.begin(), _offsets.end());
+	}
+
+	FrameSynchronizer::FrameSynchronizer(std::vector<StreamId> members, int tolerance, fs::path file) :
+										 _members(members), _tolerance(tolerance),
+										 _pending(members.size()), _clocks(), _now(0), _count(0),
+										 _file(), _m() {
+		boost::system::error_code ec;
+		bool exists = fs::file_size(file, ec) > 0 && !ec;
+		_file.open(file, std::ios::out | std::ios::binary | std::ios::app);
+		if (!_file) {
+			throw fs::filesystem_error("Unable to open frameset file", file,
+				boost::system::errc::make_error_code(boost::system::errc::io_error));
+		}
+		if (exists) {
+			return;
+		}
+
+		std::ostringstream names;
+		for (auto& m : _members) {
+			names << m.serial << '\t' << (int)m.stream << '\t' << m.name << '\n';
+		}
+		std::string s = names.str();
+		FramesetFileHeader header = { FRAMESET_MAGIC, FRAMESET_VERSION, (uint32_t)_members.size(),
+			_tolerance, (uint32_t)s.size() };
+		_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		_file.write(s.data(), s.size());
+		_file.flush();
+	}
+
+	FrameSynchronizer::~FrameSynchronizer() {
+		flush();
+	}
+
+	void FrameSynchronizer::addFrame(size_t member, int timestamp, int64_t hostTime) {
+		std::lock_guard<std::mutex> lock(_m);
+		if (member >= _members.size()) {
+			return;
+		}
+		_now = std::max(_now, hostTime);
+		int64_t time = _clocks[_members[member].serial].toHost(timestamp, hostTime);
+
+		auto& pending = _pending[member];
+		pending.push_back({ time, timestamp });
+		if (pending.size() > MAX_PENDING) {
+			pending.pop_front();
+		}
+		emit(false);
+	}
+
+	void FrameSynchronizer::flush() {
+		std::lock_guard<std::mutex> lock(_m);
+		emit(true);
+	}
+
+	uint64_t FrameSynchronizer::getFramesetCount() {
+		std::lock_guard<std::mutex> lock(_m);
+		return _count;
+	}
+
+	void FrameSynchronizer::emit(bool force) {
+		std::vector<int> timestamps(_members.size());
+		while (!_pending[0].empty()) {
+			Pending anchor = _pending[0].front();
+			bool stalled = force || _now - anchor.time > _tolerance + SYNC_STALL_MS;
+
+			bool ready = true;
+			timestamps[0] = anchor.timestamp;
+			for (size_t m = 1; m < _members.size() && ready; ++m) {
+				auto& pending = _pending[m];
+				// too old for this frameset and therefore for any later one
+				while (!pending.empty() && pending.front().time < anchor.time - _tolerance) {
+					pending.pop_front();
+				}
+				// frames arrive in order, so a closer one may still come until one lies past the window
+				if (!stalled && (pending.empty() || pending.back().time <= anchor.time + _tolerance)) {
+					ready = false;
+					break;
+				}
+
+				timestamps[m] = -1;
+				int64_t best = _tolerance;
+				for (auto& frame : pending) {
+					if (frame.time > anchor.time + _tolerance) {
+						break;
+					}
+					int64_t distance = frame.time > anchor.time ? frame.time - anchor.time : anchor.time - frame.time;
+					if (distance <= best) {
+						// ties go to the earlier frame
+						if (timestamps[m] == -1 || distance < best) {
+							timestamps[m] = frame.timestamp;
+						}
+						best = distance;
+					}
+				}
+			}
+			if (!ready) {
+				return;
+			}
+
+			_file.write(reinterpret_cast<const char*>(&anchor.time), sizeof(anchor.time));
+			for (int t : timestamps) {
+				int32_t ts = t;
+				_file.write(reinterpret_cast<const char*>(&ts), sizeof(ts));
+			}
+			_file.flush();
+			_pending[0].pop_front();
+			++_count;
+		}
+	}
+
+	FramesetReader::FramesetReader(fs::path file) : _file(file), _valid(false), _members(),
+													_tolerance(0), _offset(0), _times(),
+													_timestamps(), _columns() {
+		fs::ifstream ifs(_file, std::ios::in | std::ios::binary);
+		FramesetFileHeader header;
+		if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+				header.magic != FRAMESET_MAGIC || header.version != FRAMESET_VERSION) {
+			return;
+		}
+		std::string names(header.membersSize, '\0');
+		if (!ifs.read(&names[0], names.size())) {
+			return;
+		}
+
+		std::istringstream lines(names);
+		std::string line;
+		while (std::getline(lines, line)) {
+			std::istringstream fields(line);
+			StreamId id;
+			int strm;
+			std::getline(fields, id.serial, '\t');
+			fields >> strm;
+			fields.ignore(1);
+			std::getline(fields, id.name);
+			if (!fields) {
+				return;
+			}
+			id.stream = (rs::stream)strm;
+			_members.push_back(id);
+		}
+		if (_members.size() != header.memberCount || _members.empty()) {
+			return;
+		}
+
+		_tolerance = header.tolerance;
+		_offset = sizeof(header) + header.membersSize;
+		_columns.resize(_members.size());
+		_valid = true;
+		refresh();
+	}
+
+	void FramesetReader::refresh() {
+		if (!_valid) {
+			return;
+		}
+		boost::system::error_code ec;
+		uint64_t fileSize = fs::file_size(_file, ec);
+		size_t memberCount = _members.size();
+		uint64_t recordSize = sizeof(int64_t) + memberCount * sizeof(int32_t);
+		if (ec || fileSize < _offset + recordSize) {
+			return;
+		}
+
+		// only whole records, the writer may be in the middle of one
+		uint64_t count = (fileSize - _offset) / recordSize;
+		std::vector<char> buffer(count * recordSize);
+		fs::ifstream ifs(_file, std::ios::in | std::ios::binary);
+		ifs.seekg(_offset);
+		if (!ifs.read(buffer.data(), buffer.size())) {
+			return;
+		}
+		_offset += buffer.size();
+
+		for (uint64_t i = 0; i < count; ++i) {
+			const char* record = buffer.data() + i * recordSize;
+			size_t n = _times.size();
+			int64_t time;
+			std::memcpy(&time, record, sizeof(time));
+			_times.push_back(time);
+			for (size_t m = 0; m < memberCount; ++m) {
+				int32_t ts;
+				std::memcpy(&ts, record + sizeof(time) + m * sizeof(ts), sizeof(ts));
+				_timestamps.push_back(ts);
+				if (ts == -1) {
+					continue;
+				}
+				// timestamps nearly always arrive in order, so this appends
+				auto& column = _columns[m];
+				auto entry = std::make_pair((int)ts, n);
+				column.insert(std::upper_bound(column.begin(), column.end(), entry), entry);
+			}
+		}
+	}
+
+	bool FramesetReader::find(size_t member, int timestamp, TimestampIndex::SeekMode mode,
+			Frameset& out) const {
+		if (member >= _columns.size() || _times.empty()) {
+			return false;
+		}
+
+		size_t n;
+		if (timestamp == -1) {
+			n = _times.size() - 1;
+		} else {
+			const auto& column = _columns[member];
+			auto it = std::lower_bound(column.begin(), column.end(), std::make_pair(timestamp, (size_t)0));
+			bool exact = it != column.end() && it->first == timestamp;
+			switch (mode) {
+			case TimestampIndex::EXACT:
+				if (!exact) {
+					return false;
+				}
+				break;
+			case TimestampIndex::FLOOR:
+				if (!exact) {
+					if (it == column.begin()) {
+						return false;
+					}
+					--it;
+				}
+				break;
+			case TimestampIndex::CEIL:
+				if (it == column.end()) {
+					return false;
+				}
+				break;
+			case TimestampIndex::NEAREST:
+				if (it == column.end() || (!exact && it != column.begin() &&
+						timestamp - (it - 1)->first <= it->first - timestamp)) {
+					if (it == column.begin()) {
+						return false;
+					}
+					--it;
+				}
+				break;
+			}
+			n = it->second;
+		}
+
+		size_t memberCount = _members.size();
+		out.time = _times[n];
+		out.timestamps.assign(_timestamps.begin() + n * memberCount, _timestamps.begin() + (n + 1) * memberCount);
+		return true;
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef RSSYNC_H
+#define RSSYNC_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <mutex>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <rs.hpp>
+
+#include "rs_timestamp_index.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	const uint32_t FRAMESET_MAGIC = 0x46575352; // "RSWF"
+	const uint32_t FRAMESET_VERSION = 1;
+	// frames further apart than this (ms on the host clock) never belong together
+	const int DEFAULT_SYNC_TOLERANCE = 16;
+	// a frameset is written without the members that have not delivered a frame by then
+	const int SYNC_STALL_MS = 250;
+	// number of recent frames a device clock estimate is based on
+	const size_t CLOCK_WINDOW = 64;
+
+#pragma pack(push, 1)
+	/// Start of a frameset file, followed by membersSize bytes of "serial\tstream\tname\n"
+	/// lines and then fixed size records of an int64 host time and one int32 device
+	/// timestamp per member, -1 if the member has no frame in that set
+	struct FramesetFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t memberCount;
+		int32_t tolerance;
+		uint32_t membersSize;
+	};
+#pragma pack(pop)
+
+	/// Names one recorded stream, as passed to enableStream
+	struct StreamId {
+		std::string serial;
+		rs::stream stream;
+		std::string name;
+
+		bool operator==(const StreamId& other) const {
+			return serial == other.serial && stream == other.stream && name == other.name;
+		}
+	};
+
+	/// Frames that were captured together, timestamps are in the order of the group members
+	struct Frameset {
+		int64_t time;
+		std::vector<int> timestamps;
+	};
+
+	/// Maps timestamps of one device clock onto the host clock. The host arrival time of a
+	/// frame is its device timestamp plus a constant offset plus a transport delay that is
+	/// never negative, so the smallest difference over recent frames estimates the offset.
+	/// Using a sliding window keeps up with devices whose clock runs slightly fast or slow.
+	class ClockModel {
+	public:
+		ClockModel();
+
+		/// Adds a frame and returns its timestamp on the host clock
+		int64_t toHost(int timestamp, int64_t hostTime);
+
+	private:
+		std::deque<int64_t> _offsets;
+		int _lastTimestamp;
+	};
+
+	/// Groups frames of several streams, on one or more devices, into framesets and
+	/// appends them to a frameset file. Every frame of the first member starts a frameset,
+	/// which is completed with the closest frame of each other member within tolerance
+	/// once a later frame of that member shows that none closer can follow.
+	class FrameSynchronizer {
+	public:
+		/// Appends to file if it exists, the caller must check its members match.
+		/// throws boost::filesystem::filesystem_error if unable to open file
+		FrameSynchronizer(std::vector<StreamId> members, int tolerance, fs::path file);
+		/// Writes out framesets still waiting on other members
+		~FrameSynchronizer();
+
+		/// Adds a frame of members[member] with its device timestamp, hostTime is the host
+		/// clock in milliseconds when the frame arrived
+		void addFrame(size_t member, int timestamp, int64_t hostTime);
+		/// Writes out framesets still waiting on other members
+		void flush();
+
+		const std::vector<StreamId>& getMembers() const { return _members; }
+		uint64_t getFramesetCount();
+
+	private:
+		struct Pending {
+			int64_t time;
+			int timestamp;
+		};
+
+		std::vector<StreamId> _members;
+		int _tolerance;
+		std::vector<std::deque<Pending>> _pending;
+		// one clock per device, shared by its streams
+		std::map<std::string, ClockModel> _clocks;
+		int64_t _now;
+		uint64_t _count;
+		fs::ofstream _file;
+		std::mutex _m;
+
+		/// _m must be held
+		void emit(bool force);
+	};
+
+	/// Reads the framesets recorded by a FrameSynchronizer, picking up framesets appended
+	/// while the group is live on refresh()
+	class FramesetReader {
+	public:
+		FramesetReader(fs::path file);
+
+		/// Returns false if the file is missing or not a frameset file
+		bool valid() const { return _valid; }
+		const std::vector<StreamId>& getMembers() const { return _members; }
+		int getTolerance() const { return _tolerance; }
+		size_t size() const { return _times.size(); }
+
+		/// Reads framesets appended since the last call
+		void refresh();
+		/// Finds the frameset whose frame of members[member] matches timestamp under mode,
+		/// or the latest frameset if timestamp is -1. Returns false if none matches.
+		bool find(size_t member, int timestamp, TimestampIndex::SeekMode mode, Frameset& out) const;
+
+	private:
+		fs::path _file;
+		bool _valid;
+		std::vector<StreamId> _members;
+		int _tolerance;
+		uint64_t _offset;
+		std::vector<int64_t> _times;
+		// memberCount timestamps per frameset
+		std::vector<int> _timestamps;
+		// per member, (timestamp, frameset) sorted by timestamp
+		std::vector<std::vector<std::pair<int, size_t>>> _columns;
+	};
+}
+
+#endif
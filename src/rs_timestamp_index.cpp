@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <ios>
+
+#include <boost/interprocess/file_mapping.hpp>
+
+#include "rs_timestamp_index.h"
+#include "rs_recording.h"
+
+namespace rsw {
+	namespace bip = boost::interprocess;
+
+	static bool byTimestamp(const TimestampIndexEntry& a, const TimestampIndexEntry& b) {
+		return a.timestamp < b.timestamp;
+	}
+
+	fs::path timestampIndexPath(const fs::path& dir) {
+		return dir / "frames.rsti";
+	}
+
+	TimestampIndexWriter::TimestampIndexWriter(fs::path dir) : _lastTimestamp(INT_MIN), _sorted(true) {
+		fs::path p = timestampIndexPath(dir);
+		if (!fs::exists(p)) {
+			// Segments written before indices existed need their entries carried over
+			if (!isSegmentedRecording(dir) || !TimestampIndex::rebuild(dir)) {
+				TimestampIndexHeader header = { TIMESTAMP_INDEX_MAGIC, TIMESTAMP_INDEX_VERSION, 0, 0 };
+				fs::ofstream ofs(p, std::ios::out | std::ios::binary | std::ios::trunc);
+				ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			}
+		}
+
+		_file.open(p, std::ios::in | std::ios::out | std::ios::binary);
+		TimestampIndexHeader header;
+		if (!_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+				header.magic != TIMESTAMP_INDEX_MAGIC) {
+			throw fs::filesystem_error("Invalid timestamp index", p,
+				boost::system::errc::make_error_code(boost::system::errc::io_error));
+		}
+		_sorted = (header.flags & TIMESTAMP_INDEX_UNSORTED) == 0;
+
+		// Continue after the last complete entry
+		uint64_t count = (fs::file_size(p) - sizeof(header)) / sizeof(TimestampIndexEntry);
+		if (count > 0) {
+			TimestampIndexEntry last;
+			_file.seekg(sizeof(header) + (count - 1) * sizeof(TimestampIndexEntry), std::ios::beg);
+			if (_file.read(reinterpret_cast<char*>(&last), sizeof(last))) {
+				_lastTimestamp = last.timestamp;
+			}
+		}
+		_file.clear();
+		_file.seekp(sizeof(header) + count * sizeof(TimestampIndexEntry), std::ios::beg);
+	}
+
+	bool TimestampIndexWriter::append(int timestamp, int segment, uint64_t offset, uint32_t size) {
+		if (timestamp < _lastTimestamp && _sorted) {
+			// Readers fall back to sorting their own copy
+			_sorted = false;
+			uint32_t flags = TIMESTAMP_INDEX_UNSORTED;
+			std::streampos end = _file.tellp();
+			_file.seekp(offsetof(TimestampIndexHeader, flags), std::ios::beg);
+			_file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+			_file.seekp(end);
+		}
+		_lastTimestamp = std::max(_lastTimestamp, timestamp);
+
+		TimestampIndexEntry entry = { timestamp, segment, offset, size, 0 };
+		_file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		return static_cast<bool>(_file);
+	}
+
+	bool TimestampIndexWriter::flush() {
+		_file.flush();
+		return static_cast<bool>(_file);
+	}
+
+	void TimestampIndexWriter::close() {
+		_file.close();
+	}
+
+	TimestampIndex::TimestampIndex(fs::path dir) : _dir(dir), _region(), _mappedSize(0),
+												   _sortedCopy(), _entries(nullptr), _count(0) {
+		if (!fs::exists(timestampIndexPath(_dir)) && !rebuild(_dir)) {
+			// read-only archive, keep the index in memory instead
+			if (collectEntries(_dir, _sortedCopy)) {
+				_entries = _sortedCopy.data();
+				_count = _sortedCopy.size();
+			}
+		}
+		refresh();
+	}
+
+	void TimestampIndex::refresh() {
+		fs::path p = timestampIndexPath(_dir);
+		boost::system::error_code ec;
+		uint64_t fileSize = fs::file_size(p, ec);
+		if (ec || fileSize == _mappedSize || fileSize < sizeof(TimestampIndexHeader)) {
+			return;
+		}
+
+		std::shared_ptr<bip::mapped_region> region;
+		try {
+			bip::file_mapping file(p.string().c_str(), bip::read_only);
+			region = std::make_shared<bip::mapped_region>(file, bip::read_only, 0, fileSize);
+		} catch (const bip::interprocess_exception&) {
+			return;
+		}
+		auto header = static_cast<const TimestampIndexHeader*>(region->get_address());
+		if (header->magic != TIMESTAMP_INDEX_MAGIC) {
+			return;
+		}
+
+		// the writer only appends, anything else means the index was written anew. A copy
+		// made before anything was mapped is of the folder, not of this file.
+		if (fileSize < _mappedSize || _mappedSize == 0) {
+			_sortedCopy.clear();
+		}
+		_region = region;
+		_mappedSize = fileSize;
+		_count = (fileSize - sizeof(TimestampIndexHeader)) / sizeof(TimestampIndexEntry);
+		_entries = reinterpret_cast<const TimestampIndexEntry*>(header + 1);
+		if (header->flags & TIMESTAMP_INDEX_UNSORTED) {
+			// the copy holds the entries mapped before, sorted. Only the new tail is sorted
+			// and merged in, equal timestamps stay in the order they were written.
+			size_t sorted = std::min(_sortedCopy.size(), _count);
+			_sortedCopy.resize(sorted);
+			_sortedCopy.insert(_sortedCopy.end(), _entries + sorted, _entries + _count);
+			std::stable_sort(_sortedCopy.begin() + sorted, _sortedCopy.end(), byTimestamp);
+			std::inplace_merge(_sortedCopy.begin(), _sortedCopy.begin() + sorted, _sortedCopy.end(), byTimestamp);
+			_entries = _sortedCopy.data();
+		} else {
+			_sortedCopy.clear();
+		}
+	}
+
+	const TimestampIndexEntry* TimestampIndex::seek(int timestamp, SeekMode mode) const {
+		TimestampIndexEntry key = { timestamp, 0, 0, 0, 0 };
+		// first entry at or after timestamp
+		const TimestampIndexEntry* it = std::lower_bound(begin(), end(), key, byTimestamp);
+		bool atOrAfter = it != end();
+
+		switch (mode) {
+		case EXACT:
+			return (atOrAfter && it->timestamp == timestamp) ? it : nullptr;
+		case CEIL:
+			return atOrAfter ? it : nullptr;
+		case FLOOR:
+			if (atOrAfter && it->timestamp == timestamp) {
+				// several frames may share a timestamp, take the last one
+				return std::upper_bound(it, end(), key, byTimestamp) - 1;
+			}
+			return it == begin() ? nullptr : it - 1;
+		case NEAREST:
+			if (it == begin()) {
+				return atOrAfter ? it : nullptr;
+			}
+			if (!atOrAfter || (timestamp - (it - 1)->timestamp) <= (it->timestamp - timestamp)) {
+				return it - 1;
+			}
+			return it;
+		}
+		return nullptr;
+	}
+
+	std::pair<const TimestampIndexEntry*, const TimestampIndexEntry*> TimestampIndex::range(int from, int to) const {
+		TimestampIndexEntry lo = { from, 0, 0, 0, 0 };
+		TimestampIndexEntry hi = { to, 0, 0, 0, 0 };
+		const TimestampIndexEntry* first = std::lower_bound(begin(), end(), lo, byTimestamp);
+		const TimestampIndexEntry* last = std::upper_bound(first, end(), hi, byTimestamp);
+		return std::make_pair(first, std::max(first, last));
+	}
+
+	bool TimestampIndex::collectEntries(const fs::path& dir, std::vector<TimestampIndexEntry>& entries) {
+		entries.clear();
+		if (isSegmentedRecording(dir)) {
+			for (int n = 0; fs::exists(segmentIndexPath(dir, n)); ++n) {
+				uint64_t count = fs::file_size(segmentIndexPath(dir, n)) / sizeof(SegmentIndexEntry);
+				std::vector<SegmentIndexEntry> raw(count);
+				fs::ifstream ifs(segmentIndexPath(dir, n), std::ios::in | std::ios::binary);
+				if (!ifs.read(reinterpret_cast<char*>(raw.data()), count * sizeof(SegmentIndexEntry))) {
+					return false;
+				}
+				for (auto& e : raw) {
+					entries.push_back({ e.timestamp, n, e.offset, e.size, 0 });
+				}
+			}
+		} else {
+			// Older recordings, every frame is a file named by its timestamp
+			boost::system::error_code ec;
+			for (fs::directory_iterator it(dir, ec), itEnd; !ec && it != itEnd; it.increment(ec)) {
+				std::string name = it->path().filename().string();
+				char* nameEnd = nullptr;
+				long timestamp = std::strtol(name.c_str(), &nameEnd, 10);
+				if (name.empty() || *nameEnd != '\0' || !fs::is_regular_file(it->path())) {
+					continue;
+				}
+				entries.push_back({ (int32_t)timestamp, -1, 0, (uint32_t)fs::file_size(it->path()), 0 });
+			}
+			if (ec) {
+				return false;
+			}
+		}
+
+		std::stable_sort(entries.begin(), entries.end(), byTimestamp);
+		return true;
+	}
+
+	bool TimestampIndex::rebuild(const fs::path& dir) {
+		std::vector<TimestampIndexEntry> entries;
+		if (!collectEntries(dir, entries)) {
+			return false;
+		}
+
+		// Write to a temporary file first so readers never map a half written index
+		fs::path tmp = timestampIndexPath(dir);
+		tmp += ".tmp";
+		{
+			TimestampIndexHeader header = { TIMESTAMP_INDEX_MAGIC, TIMESTAMP_INDEX_VERSION, 0, 0 };
+			fs::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+			ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			ofs.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(TimestampIndexEntry));
+			if (!ofs) {
+				return false;
+			}
+		}
+		boost::system::error_code ec;
+		fs::rename(tmp, timestampIndexPath(dir), ec);
+		return !ec;
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef RSTIMESTAMPINDEX_H
+#define RSTIMESTAMPINDEX_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	const uint32_t TIMESTAMP_INDEX_MAGIC = 0x49575352; // "RSWI"
+	const uint32_t TIMESTAMP_INDEX_VERSION = 1;
+	// set by the writer once a timestamp arrives out of order
+	const uint32_t TIMESTAMP_INDEX_UNSORTED = 1;
+
+#pragma pack(push, 1)
+	struct TimestampIndexHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	/// Location of one frame. segment is -1 for recordings that store one file per frame,
+	/// in which case the frame is the file named by its timestamp.
+	struct TimestampIndexEntry {
+		int32_t timestamp;
+		int32_t segment;
+		uint64_t offset;
+		uint32_t size;
+		uint32_t reserved;
+	};
+#pragma pack(pop)
+
+	/// Returns path of the index covering all frames of a recording folder
+	fs::path timestampIndexPath(const fs::path& dir);
+
+	/// Appends entries to the index of a recording while it is being written
+	class TimestampIndexWriter {
+	public:
+		/// Rebuilds the index first if the folder already has frames but no index
+		TimestampIndexWriter(fs::path dir);
+
+		/// Entries become visible to readers on flush
+		bool append(int timestamp, int segment, uint64_t offset, uint32_t size);
+		bool flush();
+		void close();
+
+	private:
+		fs::fstream _file;
+		int _lastTimestamp;
+		bool _sorted;
+	};
+
+	/// Read-only, memory mapped view of the sorted index of one recording. All lookups are
+	/// binary searches over the mapping, opening a recording never enumerates its folder
+	/// unless the index is missing and has to be rebuilt.
+	class TimestampIndex {
+	public:
+		enum SeekMode {
+			EXACT = 0,
+			FLOOR,   // latest frame at or before the timestamp
+			CEIL,    // earliest frame at or after the timestamp
+			NEAREST  // closest frame, earlier one wins a tie
+		};
+
+		TimestampIndex(fs::path dir);
+
+		/// Remaps the index if the recording grew since the last call
+		void refresh();
+
+		/// Returns nullptr if no frame matches
+		const TimestampIndexEntry* seek(int timestamp, SeekMode mode) const;
+		/// Returns all entries with from <= timestamp <= to as a [first, last) range
+		std::pair<const TimestampIndexEntry*, const TimestampIndexEntry*> range(int from, int to) const;
+
+		const TimestampIndexEntry* begin() const { return _entries; }
+		const TimestampIndexEntry* end() const { return _entries + _count; }
+		size_t size() const { return _count; }
+
+		/// Writes a fresh index from the per-segment indices, or from the file names of a
+		/// one-file-per-frame recording. Returns false if the folder could not be read.
+		static bool rebuild(const fs::path& dir);
+
+	private:
+		fs::path _dir;
+		std::shared_ptr<boost::interprocess::mapped_region> _region;
+		uint64_t _mappedSize;
+		// sorted copy, only used if the writer saw timestamps out of order. Grows by merging
+		// in the entries appended since the last refresh.
+		std::vector<TimestampIndexEntry> _sortedCopy;
+		const TimestampIndexEntry* _entries;
+		size_t _count;
+
+		static bool collectEntries(const fs::path& dir, std::vector<TimestampIndexEntry>& entries);
+	};
+}
+
+#endif
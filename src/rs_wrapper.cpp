@@ -1,79 +1,170 @@
 #include <iostream>
 #include <string>
 #include <ios>
-#include <tuple>
 #include <thread>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
 
 #include "boost/filesystem/fstream.hpp"
+#include "rs_log.h"
 #include "rs_wrapper.h"
 #include "rs.hpp"
-#include "glfw3.h"
-
-#define TEST_SERIAL "023150187408"
 
 namespace rsw {
-	RealSenseWrapper::RealSenseWrapper(std::string directory) :
-									   ctx(), _deviceMap(), _deviceMapM(), 
-									   dataPath(directory) {
-		rs::log_to_console(rs::log_severity::debug);
+	namespace {
+		/// librealsense has no trace level, its debug messages are the closest
+		rs::log_severity toSeverity(LogLevel level) {
+			switch (level) {
+			case LOG_TRACE:
+			case LOG_DEBUG:
+				return rs::log_severity::debug;
+			case LOG_INFO:
+				return rs::log_severity::info;
+			case LOG_WARN:
+				return rs::log_severity::warn;
+			case LOG_ERROR:
+				return rs::log_severity::error;
+			case LOG_OFF:
+				break;
+			}
+			return rs::log_severity::none;
+		}
+	}
+
+	RealSenseWrapper::RealSenseWrapper(std::string directory, DiskWriter::Config writerConfig,
+									   size_t ringCapacity) :
+									   ctx(new rs::context()), dataPath(directory), _catalog(nullptr),
+									   _devices(), _streams(), _readers(), _metrics(), _diskWriter(writerConfig),
+									   _ringCapacity(ringCapacity) {
+		// follows the wrapper's own level as it is when the wrapper is created
+		rs::log_to_console(toSeverity(getLogLevel()));
+
+		std::vector<DeviceSource*> sources;
+		for (int i = 0; i < ctx->get_device_count(); ++i) {
+			sources.push_back(new RealSenseSource(ctx->get_device(i)));
+		}
+		open(sources);
+	}
+
+	RealSenseWrapper::RealSenseWrapper(std::string directory, std::vector<DeviceSource*> sources,
+									   DiskWriter::Config writerConfig, size_t ringCapacity) :
+									   ctx(nullptr), dataPath(directory), _catalog(nullptr),
+									   _devices(), _streams(), _readers(), _metrics(), _diskWriter(writerConfig),
+									   _ringCapacity(ringCapacity) {
+		open(sources);
+	}
+
+	void RealSenseWrapper::open(const std::vector<DeviceSource*>& sources) {
+		// Track the latest timestamp that is safely on disk for each recording
+		_diskWriter.setWrittenCallback([this](const fs::path& p, int timestamp) {
+			auto stream = _streams.find(p);
+			if (stream) {
+				stream->lastWritten.store(timestamp, std::memory_order_relaxed);
+			}
+		});
 		
 		// Open directory, check validity
 		if (fs::exists(dataPath) && fs::is_directory(dataPath)) {
-			// Initialize mapping
-			for (auto dirEnt : fs::directory_iterator(dataPath)) {
-				std::string fn = dirEnt.path().filename().string();
-				std::cout << "Found recordings for device: " << fn << std::endl;
-				_deviceMap[fn] = std::pair<rs::device*, std::mutex*>(nullptr, nullptr);
+			// Initialize mapping from the catalog rather than walking the folders
+			_catalog = new Catalog(dataPath);
+			for (auto serial : _catalog->getSerials()) {
+				RSW_LOG(LOG_INFO, "Found recordings for device: " << serial);
+				_devices.assign(serial, std::make_shared<DeviceState>(serial, nullptr));
 			}
+			_diskWriter.setClosedCallback([this](const fs::path& p) {
+				_catalog->finishRecording(p);
+			});
 
 			// Find matching connected devices, add to map
-			for (int i = 0; i < ctx.get_device_count(); ++i) {
-				std::string serial = std::string(ctx.get_device(i)->get_serial());
-				std::cout << "Found connected device: " << serial << std::endl;
+			for (auto source : sources) {
+				std::string serial = source->getSerial();
+				RSW_LOG(LOG_INFO, "Found connected device: " << serial);
 				
-				if (_deviceMap.count(serial) == 0) {
+				if (!_devices.find(serial)) {
 					// No recordings exist, create a folder
 					fs::create_directory(dataPath / serial);
+					_catalog->addDevice(serial);
 				}
-				_deviceMap[serial] = std::make_tuple(ctx.get_device(i), new std::mutex(),
-					std::get<2>(_deviceMap[serial]));
+				_devices.assign(serial, std::make_shared<DeviceState>(serial, source));
 			}
 		}
 		else {
+			for (auto source : sources) {
+				delete source;
+			}
 			throw new std::invalid_argument("Invalid argument: Unable to open folder");
 		}
 	}
 
 	RealSenseWrapper::~RealSenseWrapper() {
-		// Stop all threads
-		for (auto dev : _deviceMap) {
-			for (auto threads : std::get<2>(dev.second)) {
-			}
+		// Stop all capture threads
+		_devices.clear();
+		// Nothing is captured anymore, write out framesets still waiting on late frames
+		_syncTargets.clear();
+		_syncGroups.clear();
+
+		// Close playback readers
+		_readers.clear();
+		for (auto reader : _framesetReaders) {
+			delete reader.second;
 		}
-		// Release all mutexes
+		// Write out what is still queued, the catalog is updated as each recording closes
+		_streams.forEach([this](const fs::path& p, const std::shared_ptr<StreamState>&) {
+			_diskWriter.closeRecording(p);
+		});
+		_diskWriter.shutdown();
+		delete _catalog;
+		delete ctx;
 	}
 
 	std::vector<std::string>* RealSenseWrapper::getDeviceList() {
 		std::vector<std::string>* out = new std::vector<std::string>();
-		_deviceMapM.lock_shared();
-		for (auto items : _deviceMap) {
-			out->push_back(items.first);
-		}
-		_deviceMapM.unlock_shared();
+		_devices.forEach([out](const std::string& serial, const std::shared_ptr<DeviceState>&) {
+			out->push_back(serial);
+		});
+		std::sort(out->begin(), out->end());
 		return out;
 	}
 
+	DiskWriter::Stats RealSenseWrapper::getWriterStats() {
+		return _diskWriter.getStats();
+	}
+
+	std::vector<StreamMetricsSnapshot> RealSenseWrapper::getMetrics() {
+		return _metrics.snapshot();
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::startMetricsDump(std::string file, int intervalMs) {
+		fs::path p(file);
+		fs::path dir = p.has_parent_path() ? p.parent_path() : fs::current_path();
+		if (intervalMs <= 0 || !fs::is_directory(dir)) {
+			return UNABLE_TO_ACCESS;
+		}
+		_metrics.startDump(p, intervalMs);
+		return NO_ERROR;
+	}
+
+	void RealSenseWrapper::stopMetricsDump() {
+		_metrics.stopDump();
+	}
+
 	void RealSenseWrapper::printStatus() {
-		_deviceMapM.lock_shared();
-		for (auto items : _deviceMap) {
-			rs::device* dev = items.second.first;
+		auto recordings = _catalog->getRecordings();
+		std::map<std::string, std::shared_ptr<DeviceState>> devices;
+		_devices.forEach([&devices](const std::string& serial, const std::shared_ptr<DeviceState>& device) {
+			devices[serial] = device;
+		});
+		for (auto items : devices) {
+			const DeviceState& device = *items.second;
 			std::cout << items.first << ": " << std::endl;
-			if (dev == nullptr) {
+			if (device.source == nullptr) {
 				std::cout << "  Connected: No" << std::endl;
 			} else {
-				items.second.second->lock();
 				std::cout << "  Connected: Yes" << std::endl;
-				std::cout << "  Device: " << dev->get_name() << std::endl;
+				std::cout << "  Device: " << device.name << std::endl;
 				/*
 				std::cout << "  Supported Streams: " << std::endl;
 
@@ -95,238 +186,507 @@ namespace rsw {
 					}
 				}
 				*/
-				items.second.second->unlock();
+				std::cout << "  Capturing: " << (device.engine->isRunning() ? "Yes" : "No") << std::endl;
+				std::string error = device.engine->getError();
+				if (!error.empty()) {
+					std::cout << "  Capture stopped on error: " << error << std::endl;
+				}
 			}
 
 			std::cout << "  Available Playback:" << std::endl;
-			for (auto stream : fs::directory_iterator(dataPath / items.first)) {
-				std::cout << "    " << stream.path().stem() << std::endl;
-				for (auto strmName : fs::directory_iterator(stream.path())) {
-					std::cout << "      " << strmName.path().stem() << std::endl;
+			int lastStream = -1;
+			for (auto rec : recordings) {
+				if (rec.serial != items.first) {
+					continue;
+				}
+				if ((int)rec.stream != lastStream) {
+					std::cout << "    " << rec.stream << std::endl;
+					lastStream = (int)rec.stream;
 				}
+				std::cout << "      " << rec.name << ": " << rec.width << "x" << rec.height << " " <<
+					rec.format << " @ " << rec.framerate << "Hz, " << rec.frameCount << " frames [" <<
+					rec.firstTimestamp << ", " << rec.lastTimestamp << "]";
+				auto stream = _streams.find(dataPath / rec.serial / rs_stream_to_string((rs_stream)rec.stream) / rec.name);
+				if (stream) {
+					std::cout << " (recording, captured " << stream->lastCaptured << ", written " <<
+						stream->lastWritten << ")";
+					StreamMetricsSnapshot m = stream->metrics->snapshot();
+					std::cout << std::endl << "        " << m.counters[FRAMES_CAPTURED] << " captured, " <<
+						m.counters[FRAMES_WRITTEN] << " written, " << m.counters[FRAMES_DROPPED] << " dropped, " <<
+						m.counters[WRITE_ERRORS] << " failed, " << m.counters[BYTES_WRITTEN] << " bytes, " <<
+						"capture to write p50 " << m.histograms[CAPTURE_TO_WRITE_US].p50 << "us p99 " <<
+						m.histograms[CAPTURE_TO_WRITE_US].p99 << "us";
+				}
+				std::cout << std::endl;
 			}
 		}
-		_deviceMapM.unlock_shared();
+	}
+
+	int RealSenseWrapper::verifyCatalog(bool rebuild) {
+		if (rebuild) {
+			_catalog->rebuild();
+			return 0;
+		}
+		return _catalog->verify();
+	}
+
+	std::shared_ptr<ReaderState> RealSenseWrapper::openReader(const fs::path& p) {
+		auto reader = _readers.find(p);
+		if (!reader) {
+			// maps the recording's timestamp index, building it first for older recordings.
+			// If another thread opened it meanwhile, its reader is used instead.
+			reader = _readers.insert(p, std::make_shared<ReaderState>(p));
+		}
+		return reader;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::getFrame(FrameHandle& frame,
+		std::string serial, rs::stream strm, std::string streamName, int timestamp,
+		TimestampIndex::SeekMode mode) {
+
+		fs::path p = dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName;
+
+		// Serve recent frames of live streams from memory
+		auto stream = _streams.find(p);
+		if (stream && (timestamp == -1 || mode == TimestampIndex::EXACT)) {
+			auto recent = (timestamp == -1) ? stream->ring.latest() : stream->ring.find(timestamp);
+			if (recent) {
+				frame = FrameHandle(recent, recent->data.data(), recent->data.size(),
+					recent->width, recent->height, recent->format, recent->timestamp);
+				return NO_ERROR;
+			}
+		}
+
+		if (!fs::is_directory(p)) {
+			return UNABLE_TO_ACCESS;
+		}
+
+		auto state = openReader(p);
+		std::lock_guard<std::mutex> lock(state->m);
+		RecordingReader* reader = &state->reader;
+		// Index entries are only written once their frame is complete, so the latest
+		// indexed timestamp is always readable
+		reader->refresh();
+		if (timestamp == -1) {
+			timestamp = reader->latestTimestamp();
+			mode = TimestampIndex::EXACT;
+		}
+		return reader->map(timestamp, frame, mode) ? NO_ERROR : UNABLE_TO_ACCESS;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::getTimestamps(std::vector<int>& timestamps,
+		std::string serial, rs::stream strm, std::string streamName, int from, int to) {
+
+		fs::path p = dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName;
+		if (!fs::is_directory(p)) {
+			return UNABLE_TO_ACCESS;
+		}
+
+		auto state = openReader(p);
+		std::lock_guard<std::mutex> lock(state->m);
+		RecordingReader* reader = &state->reader;
+		reader->refresh();
+		auto range = reader->getIndex().range(from, to);
+		timestamps.clear();
+		for (auto e = range.first; e != range.second; ++e) {
+			timestamps.push_back(e->timestamp);
+		}
+		return NO_ERROR;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::rebuildIndex(std::string serial, rs::stream strm,
+		std::string streamName) {
+
+		fs::path p = dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName;
+		if (_streams.find(p) || !fs::is_directory(p)) {
+			return UNABLE_TO_ACCESS;
+		}
+
+		// drop the reader so the next lookup maps the new index, after lookups in progress
+		std::unique_lock<std::mutex> lock;
+		auto reader = _readers.erase(p);
+		if (reader) {
+			lock = std::unique_lock<std::mutex>(reader->m);
+		}
+		return TimestampIndex::rebuild(p) ? NO_ERROR : UNABLE_TO_ACCESS;
 	}
 
 	RealSenseWrapper::RSError RealSenseWrapper::getFrame(std::vector<char>** data,
 		std::string serial, rs::stream strm, std::string streamName, int timestamp) {
+		FrameHandle frame;
+		RSError err = getFrame(frame, serial, strm, streamName, timestamp);
+		if (err == NO_ERROR) {
+			*data = new std::vector<char>(frame.data(), frame.data() + frame.size());
+		}
+		return err;
+	}
 
+	RealSenseWrapper::RSError RealSenseWrapper::getFrame(FrameHandle& frame, std::string serial,
+		rs::stream strm, std::string streamName, rs::format fmt, int timestamp, TimestampIndex::SeekMode mode) {
+		FrameHandle raw;
+		RSError err = getFrame(raw, serial, strm, streamName, timestamp, mode);
+		if (err != NO_ERROR) {
+			return err;
+		}
+		return convertFrame(raw, fmt, frame) ? NO_ERROR : UNABLE_TO_ACCESS;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::getCalibration(StreamCalibration& calibration,
+		std::string serial, rs::stream strm, std::string streamName) {
 		fs::path p = dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName;
+		return readCalibration(p, calibration) ? NO_ERROR : UNABLE_TO_ACCESS;
+	}
 
-		// Check if timestamp is available/if latest frame is available
-		_writeInfoM.lock_shared();
-		auto writingInfo = _writeInfo.find(p);
-		bool accessible = false;
-		if (writingInfo == _writeInfo.end() || (timestamp < std::get<1>(writingInfo->second))) {
-			accessible = true;
-		} else if (timestamp == -1) {
-			// get latest accessible timestamp
-			timestamp = std::get<1>(writingInfo->second);
-			while (--timestamp >= 0) {
-				if (fs::exists(p / std::to_string(timestamp))) {
-					accessible = true;
-					break;
-				}
-			}
+	RealSenseWrapper::RSError RealSenseWrapper::getPointCloud(const PointCloud& cloud, std::string serial,
+		std::string depthName, std::string colorName, int timestamp, TimestampIndex::SeekMode mode) {
+		fs::path depthPath = dataPath / serial / rs_stream_to_string(RS_STREAM_DEPTH) / depthName;
+		fs::path colorPath;
+		if (!colorName.empty()) {
+			colorPath = dataPath / serial / rs_stream_to_string(RS_STREAM_COLOR) / colorName;
 		}
-		_writeInfoM.unlock_shared();
-
-		if (accessible) {
-			// Read path
-			if (fs::is_regular_file(p / std::to_string(timestamp))) {
-				fs::ifstream ifs(p / std::to_string(timestamp), std::ios::in | std::ios::binary);
-				std::streamsize size = ifs.tellg();
-				ifs.seekg(0, std::ios::beg);
-				auto readData = new std::vector<char>(size);
-				if (ifs.read(readData->data(), size)) {
-					*data = readData;
-					return NO_ERROR;
+
+		std::shared_ptr<PointCloudGenerator> generator;
+		{
+			std::lock_guard<std::mutex> lock(_pointCloudsM);
+			auto key = std::make_pair(depthPath, colorPath);
+			auto it = _pointClouds.find(key);
+			if (it != _pointClouds.end()) {
+				generator = it->second;
+			} else {
+				// the ray tables are built once per recording
+				StreamCalibration depth;
+				StreamCalibration color;
+				if (!readCalibration(depthPath, depth) || (!colorName.empty() && !readCalibration(colorPath, color))) {
+					return UNABLE_TO_ACCESS;
 				}
+				int threads = std::max(1, std::min(DEFAULT_POINTCLOUD_THREADS, (int)std::thread::hardware_concurrency()));
+				generator = colorName.empty() ? std::make_shared<PointCloudGenerator>(depth, threads) :
+					std::make_shared<PointCloudGenerator>(depth, color, threads);
+				_pointClouds[key] = generator;
 			}
 		}
-		return UNABLE_TO_ACCESS;
+
+		FrameHandle frame;
+		RSError err = getFrame(frame, serial, rs::stream::depth, depthName, timestamp, mode);
+		if (err != NO_ERROR) {
+			return err;
+		}
+		if (frame.format() != rs::format::z16 || frame.width() != generator->getWidth() ||
+				frame.height() != generator->getHeight()) {
+			return UNABLE_TO_ACCESS;
+		}
+		generator->generate(reinterpret_cast<const uint16_t*>(frame.data()), cloud);
+		return NO_ERROR;
 	}
 
-	// Copied from librealsense/src/image.cpp
-	int getImgSize(int width, int height, rs_format format) {
-		switch (format)
-		{
-		case RS_FORMAT_Z16: return width * height * 2;
-		case RS_FORMAT_DISPARITY16: return width * height * 2;
-		case RS_FORMAT_XYZ32F: return width * height * 12;
-		case RS_FORMAT_YUYV: assert(width % 2 == 0); return width * height * 2;
-		case RS_FORMAT_RGB8: return width * height * 3;
-		case RS_FORMAT_BGR8: return width * height * 3;
-		case RS_FORMAT_RGBA8: return width * height * 4;
-		case RS_FORMAT_BGRA8: return width * height * 4;
-		case RS_FORMAT_Y8: return width * height;
-		case RS_FORMAT_Y16: return width * height * 2;
-		case RS_FORMAT_RAW10: assert(width % 4 == 0); return width * 5 / 4 * height;
-		default: assert(false); return 0;
+	fs::path RealSenseWrapper::framesetPath(const std::string& serial, const std::string& groupName) {
+		// inside the device folder, where the catalog does not mistake it for a device
+		return dataPath / serial / "framesets" / (groupName + ".rsfs");
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::addSyncGroup(std::string groupName,
+		std::vector<StreamId> members, int tolerance) {
+
+		if (members.size() < 2 || tolerance < 0) {
+			return UNABLE_TO_ACCESS;
+		}
+		for (auto& m : members) {
+			if (!_devices.find(m.serial)) {
+				return UNABLE_TO_ACCESS;
+			}
 		}
+
+		std::lock_guard<std::mutex> lock(_syncM);
+		fs::path file = framesetPath(members[0].serial, groupName);
+		if (_syncGroups.count(groupName) != 0) {
+			return UNABLE_TO_ACCESS;
+		}
+		// a group recorded before may only continue with the same members
+		if (fs::exists(file) && FramesetReader(file).getMembers() != members) {
+			return UNABLE_TO_ACCESS;
+		}
+
+		std::shared_ptr<FrameSynchronizer> sync;
+		try {
+			fs::create_directories(file.parent_path());
+			sync = std::make_shared<FrameSynchronizer>(members, tolerance, file);
+		} catch (const fs::filesystem_error& e) {
+			RSW_LOG(LOG_ERROR, e.what());
+			return UNABLE_TO_ACCESS;
+		}
+		_syncGroups[groupName] = sync;
+		for (size_t i = 0; i < members.size(); ++i) {
+			fs::path p = dataPath / members[i].serial / rs_stream_to_string((rs_stream)members[i].stream) /
+				members[i].name;
+			// capture threads keep using the old list until the new one is published
+			auto targets = _syncTargets.find(p);
+			auto next = std::make_shared<SyncTargets>(targets ? *targets : SyncTargets());
+			next->push_back(std::make_pair(sync, i));
+			_syncTargets.assign(p, next);
+		}
+		return NO_ERROR;
 	}
 
-	void RealSenseWrapper::writeImgLoop(fs::path p, std::string serial, rs::stream strm,
-			int width, int height, rs::format fmt, int framerate) {
-		_deviceMapM.lock_shared();
-		_deviceMap[serial].second->lock();
-		auto dev = _deviceMap[serial].first;
-		if (dev->is_streaming()) {
-			dev->stop();
-		}
-		dev->enable_stream(strm, width, height, fmt, framerate);
-		dev->start();
-		_deviceMap[serial].second->unlock();
-		_deviceMapM.unlock_shared();
-
-		int imgSize = getImgSize(width, height, (rs_format)fmt);
-
-		while (true) {
-			_writeInfoM.lock_shared();
-			// check if we should stop
-			if (std::get<2>(_writeInfo[p]) == true) {
-				break;
+	RealSenseWrapper::RSError RealSenseWrapper::removeSyncGroup(std::string groupName) {
+		std::lock_guard<std::mutex> lock(_syncM);
+		auto group = _syncGroups.find(groupName);
+		if (group == _syncGroups.end()) {
+			return UNABLE_TO_ACCESS;
+		}
+		std::shared_ptr<FrameSynchronizer> sync = group->second;
+		std::vector<std::pair<fs::path, std::shared_ptr<SyncTargets>>> changed;
+		_syncTargets.forEach([&](const fs::path& p, const std::shared_ptr<const SyncTargets>& targets) {
+			auto next = std::make_shared<SyncTargets>();
+			for (auto& target : *targets) {
+				if (target.first != sync) {
+					next->push_back(target);
+				}
+			}
+			if (next->size() != targets->size()) {
+				changed.push_back(std::make_pair(p, next));
+			}
+		});
+		for (auto& targets : changed) {
+			if (targets.second->empty()) {
+				_syncTargets.erase(targets.first);
 			} else {
-				_deviceMapM.lock_shared();
-				_deviceMap[serial].second->lock();
-				rs::device* dev = _deviceMap[serial].first;
-				if (dev->poll_for_frames()) {
-					int timestamp = dev->get_frame_timestamp(strm);
-					const char* data = static_cast<const char*>(dev->get_frame_data(strm));
-					fs::ofstream ofs(p / std::to_string(timestamp));
+				_syncTargets.assign(targets.first, targets.second);
+			}
+		}
+		_syncGroups.erase(group);
+		// a capture thread may still hold the group, it is released after its last frame
+		sync->flush();
+		return NO_ERROR;
+	}
 
-					std::cout << "Writing image";
+	bool RealSenseWrapper::findFrameset(int timestamp, const std::vector<StreamId>& members,
+		TimestampIndex::SeekMode mode, std::vector<int>& timestamps) {
+
+		// groups are stored with the device of their first member, which may be any of these
+		std::set<std::string> serials;
+		for (auto& m : members) {
+			serials.insert(m.serial);
+		}
+		for (auto& serial : serials) {
+			fs::path dir = dataPath / serial / "framesets";
+			if (!fs::is_directory(dir)) {
+				continue;
+			}
+			for (auto& entry : fs::directory_iterator(dir)) {
+				if (entry.path().extension() != ".rsfs") {
+					continue;
+				}
+				auto reader = _framesetReaders.find(entry.path());
+				if (reader == _framesetReaders.end()) {
+					reader = _framesetReaders.emplace(entry.path(), new FramesetReader(entry.path())).first;
+				}
 
-					// write to file
-					ofs.write(data, imgSize);
+				// column of each requested member within the group
+				const auto& groupMembers = reader->second->getMembers();
+				std::vector<size_t> columns;
+				for (auto& m : members) {
+					auto column = std::find(groupMembers.begin(), groupMembers.end(), m);
+					if (column == groupMembers.end()) {
+						break;
+					}
+					columns.push_back(column - groupMembers.begin());
+				}
+				if (columns.size() != members.size()) {
+					continue;
+				}
 
-					_writeInfo[p] = std::make_tuple(std::get<0>(_writeInfo[p]), timestamp, false);
+				reader->second->refresh();
+				Frameset frameset;
+				if (!reader->second->find(columns[0], timestamp, mode, frameset)) {
+					return false;
 				}
-				_deviceMap[serial].second->unlock();
-				_deviceMapM.unlock_shared();
+				timestamps.clear();
+				for (size_t column : columns) {
+					timestamps.push_back(frameset.timestamps[column]);
+				}
+				return true;
 			}
-			_writeInfoM.unlock_shared();
-			std::this_thread::yield();
 		}
+		return false;
 	}
 
-	RealSenseWrapper::RSError RealSenseWrapper::enableStream(std::string serial,
-			rs::stream strm, std::string streamName, int width, int height,
-			rs::format fmt, int framerate) {
-		fs::path p(dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName);
-		_deviceMapM.lock_shared();
-		_writeInfoM.lock_shared();
-		// Check if we're writing to this stream already or if the name already exists
-		if ((_writeInfo.find(p) == _writeInfo.end()) && !fs::exists(p) && 
-				_deviceMap[serial].first != nullptr) {
-			_writeInfoM.unlock_shared();
-			// Create folders
-			fs::create_directories(p);
-
-			// Start thread 
-			auto writeThread = new std::thread(&RealSenseWrapper::writeImgLoop, this,
-				p, serial, strm, width, height, fmt, framerate);
-
-			_writeInfoM.lock();
-			_writeInfo[p] = std::make_tuple(writeThread, 0, false);
-			_writeInfoM.unlock();
-
-			_deviceMapM.unlock_shared();
-			return NO_ERROR;
-		} else {
-			_writeInfoM.unlock_shared();
+	RealSenseWrapper::RSError RealSenseWrapper::getFrameset(std::vector<FrameHandle>& frames,
+		int timestamp, std::vector<StreamId> members, TimestampIndex::SeekMode mode) {
+
+		if (members.empty()) {
 			return UNABLE_TO_ACCESS;
 		}
-	}
+		frames.assign(members.size(), FrameHandle());
+
+		std::vector<int> timestamps;
+		_framesetsM.lock();
+		bool recorded = findFrameset(timestamp, members, mode, timestamps);
+		_framesetsM.unlock();
+		if (recorded) {
+			for (size_t i = 0; i < members.size(); ++i) {
+				if (timestamps[i] != -1) {
+					getFrame(frames[i], members[i].serial, members[i].stream, members[i].name, timestamps[i]);
+				}
+			}
+			return frames[0].empty() ? UNABLE_TO_ACCESS : NO_ERROR;
+		}
 
-	RealSenseWrapper::RSError RealSenseWrapper::stopDevice(std::string serial) {
-		_deviceMapM.lock_shared();
-		if (_deviceMap[serial].first != nullptr) {
-			_writeInfoM.lock();
-			if (_writeInfo.find(p) != _writeInfo.end()) {
-				_writeInfo[p] = std::make_tuple(std::get<0>(_writeInfo[p]),
-					std::get<1>(_writeInfo[p]), true);
+		// Without a sync group only streams of one device can be matched, they share a clock
+		for (auto& m : members) {
+			if (m.serial != members[0].serial) {
+				return UNABLE_TO_ACCESS;
+			}
+		}
+		RSError err = getFrame(frames[0], members[0].serial, members[0].stream, members[0].name,
+			timestamp, mode);
+		if (err != NO_ERROR) {
+			return err;
+		}
+		int anchor = frames[0].timestamp();
+		for (size_t i = 1; i < members.size(); ++i) {
+			getFrame(frames[i], members[i].serial, members[i].stream, members[i].name, anchor,
+				TimestampIndex::NEAREST);
+			if (!frames[i].empty() && std::abs(frames[i].timestamp() - anchor) > DEFAULT_SYNC_TOLERANCE) {
+				frames[i].reset();
 			}
-			_writeInfoM.unlock();
 		}
-		_deviceMapM.unlock_shared();
 		return NO_ERROR;
 	}
- }
 
+	RealSenseWrapper::RSError RealSenseWrapper::openPlayback(PlaybackSession** session,
+		std::vector<StreamId> members, double rate, size_t bufferFrames) {
 
-}
+		if (members.empty()) {
+			return UNABLE_TO_ACCESS;
+		}
+		std::vector<fs::path> recordings;
+		for (auto& m : members) {
+			fs::path p = dataPath / m.serial / rs_stream_to_string((rs_stream)m.stream) / m.name;
+			if (!fs::is_directory(p)) {
+				return UNABLE_TO_ACCESS;
+			}
+			recordings.push_back(p);
+		}
+		*session = new PlaybackSession(recordings, rate, bufferFrames);
+		return NO_ERROR;
+	}
 
-using namespace std;
+	void RealSenseWrapper::writeFrame(StreamState& stream, int timestamp, const void* data) {
+		int64_t arrival = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		// Only copy the frame out on the capture thread, the disk writer threads do the rest
+		auto frame = _diskWriter.acquireFrame(stream.imgSize);
+		frame->recording = stream.recording;
+		frame->stream = stream.config.stream;
+		frame->format = stream.config.format;
+		frame->width = stream.config.width;
+		frame->height = stream.config.height;
+		frame->timestamp = timestamp;
+		frame->metrics = stream.metrics.get();
+		memcpy(frame->data.data(), data, stream.imgSize);
+		// the ring and the disk writer share the same buffer
+		stream.ring.push(frame);
+		stream.lastCaptured.store(timestamp, std::memory_order_relaxed);
+		stream.metrics->count(FRAMES_CAPTURED);
+		_diskWriter.submit(std::move(frame));
+		RSW_LOG(LOG_TRACE, "Captured frame " << timestamp << " of " << stream.recording);
+
+		auto targets = _syncTargets.find(stream.recording);
+		if (targets) {
+			for (auto& target : *targets) {
+				target.first->addFrame(target.second, timestamp, arrival);
+			}
+		}
+	}
 
-int main(void) try {
-	std::string dirName = "C:\\Users\\yimmy\\Documents\\work\\CAMP2016\\rswrapper_frames";
-	rsw::RealSenseWrapper realsense(dirName);
+	RealSenseWrapper::RSError RealSenseWrapper::enableStream(std::string serial,
+			rs::stream strm, std::string streamName, int width, int height,
+			rs::format fmt, int framerate) {
+		fs::path p(dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName);
+		auto device = _devices.find(serial);
+		if (!device || device->source == nullptr || fs::exists(p)) {
+			return UNABLE_TO_ACCESS;
+		}
 
-	// TEST: get list of devices
-	std::vector<std::string>* deviceList = realsense.getDeviceList();
-	for (auto str : *deviceList) {
-		std::cout << "Device Serial: " << str << std::endl;
-	}
-	delete deviceList;
-
-	// TEST: print status of devices (attached/not attached, available playback, if stream is streaming)
-	realsense.printStatus();
-
-	vector<char>** depthData = new vector<char>*;
-	vector<char>** colorData = new vector<char>*;
-	int ret;
-
-	// TEST: starting multiple streams
-	ret = realsense.enableStream(TEST_SERIAL, rs::stream::color, "serial_color", 640, 480, rs::format::rgb8, 30);
-	ret = realsense.enableStream(TEST_SERIAL, rs::stream::depth, "serial_depth", 640, 480, rs::format::z16, 30);
-
-	ret = realsense.startDevice(TEST_SERIAL);
-
-	// TEST: stopping all streams
-	ret = realsense.stopDevice(TEST_SERIAL);
-
-	// TEST: grabbing frame data from stopped stream and from live stream
-	glfwInit();
-	GLFWwindow * win = glfwCreateWindow(1300, 1000, "depth and color", nullptr, nullptr);
-	while (true) {
-		ret = realsense.getFrame(colorData, TEST_SERIAL, rs::stream::color, "serial_color");
-		ret = realsense.getFrame(depthData, TEST_SERIAL, rs::stream::depth, "serial_depth");
-		ret = 1;
-		glfwPollEvents();
-		if (ret == rsw::RealSenseWrapper::RSError::NO_ERROR) {
-			glfwMakeContextCurrent(win);
-			glClear(GL_COLOR_BUFFER_BIT);
-			glPixelZoom(1, -1);
-			glRasterPos2f(0, 1);
-			glDrawPixels(640, 480, GL_RGB, GL_UNSIGNED_BYTE, &colorData[0]);
-			//glRasterPos2f(640, 1);
-			//glDrawPixels(640, 480, GL_RGB, GL_UNSIGNED_BYTE, &depthData[0]);
-			glfwSwapBuffers(win);
-			delete *colorData;
-			delete *depthData;
+		// Claim the recording folder, a concurrent call for the same name gets the other state back
+		CaptureEngine::StreamConfig config = { strm, width, height, fmt, framerate };
+		auto stream = std::make_shared<StreamState>(p, config, _ringCapacity,
+			_metrics.getStream(serial, rs_stream_to_string((rs_stream)strm), streamName));
+		if (_streams.insert(p, stream) != stream) {
+			return UNABLE_TO_ACCESS;
 		}
+		// the ring keeps frames out of the writer's pool, which would otherwise run dry
+		_diskWriter.reserveFrames(_ringCapacity, stream->imgSize);
+
+		// Create folders and an empty index, so readers never try to rebuild a live recording
+		fs::create_directories(p);
+		TimestampIndexWriter(p).close();
+
+		int consumer = device->engine->addConsumer(config,
+			[this, stream](const CaptureEngine::StreamConfig&, int timestamp, const void* data) {
+				writeFrame(*stream, timestamp, data);
+			},
+			[stream](const StreamCalibration& calibration) {
+				// kept next to the frames so recordings can be deprojected later
+				if (!writeCalibration(stream->recording, calibration)) {
+					RSW_LOG(LOG_WARN, "Unable to write calibration of " << stream->recording);
+				}
+			});
+		if (consumer == -1) {
+			// stream is already enabled in a different mode on this device
+			_streams.erase(p);
+			_diskWriter.releaseFrames(_ringCapacity);
+			fs::remove_all(p);
+			return UNABLE_TO_ACCESS;
+		}
+		stream->consumer = consumer;
+
+		RecordingInfo info = { serial, strm, streamName, fmt, width, height, framerate, 0, -1, -1, true };
+		_catalog->beginRecording(info);
+		return NO_ERROR;
 	}
 
-	delete colorData;
-	delete depthData;
-	glfwTerminate();
+	RealSenseWrapper::RSError RealSenseWrapper::disableStream(std::string serial,
+			rs::stream strm, std::string streamName) {
+		fs::path p(dataPath / serial / rs_stream_to_string((rs_stream)strm) / streamName);
+		auto device = _devices.find(serial);
+		if (!device || device->source == nullptr) {
+			return UNABLE_TO_ACCESS;
+		}
 
-	ret = realsense.stopDevice(TEST_SERIAL);
+		// still being enabled
+		auto stream = _streams.find(p);
+		if (!stream || stream->consumer == -1) {
+			return UNABLE_TO_ACCESS;
+		}
+		// only one concurrent call gets to remove it
+		if (_streams.erase(p) != stream) {
+			return UNABLE_TO_ACCESS;
+		}
 
-	// TODO: test stream name conflicts
-	std::cout << "Waiting...";
-	std::string i;
-	std::cin >> i;
-	return 0;
-}
-catch (const rs::error & e)
-{
-	std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
-	return EXIT_FAILURE;
-}
-catch (const std::exception & e) {
-	std::cout << e.what() << std::endl;
-	return EXIT_FAILURE;
+		// No more frames arrive for p once the consumer is removed
+		device->engine->removeConsumer(stream->consumer);
+		_diskWriter.closeRecording(p);
+		_diskWriter.releaseFrames(_ringCapacity);
+		return NO_ERROR;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::startDevice(std::string serial) {
+		auto device = _devices.find(serial);
+		if (!device || device->source == nullptr) {
+			return UNABLE_TO_ACCESS;
+		}
+		device->engine->start();
+		return NO_ERROR;
+	}
+
+	RealSenseWrapper::RSError RealSenseWrapper::stopDevice(std::string serial) {
+		auto device = _devices.find(serial);
+		if (!device || device->source == nullptr) {
+			return UNABLE_TO_ACCESS;
+		}
+		device->engine->stop();
+		return NO_ERROR;
+	}
 }
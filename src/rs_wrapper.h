@@ -2,18 +2,31 @@
 #define RSWRAPPER_H
 
 #include <vector>
-#include <tuple>
 #include <map>
 #include <string>
 #include <exception>
 #include <thread>
-#include <shared_mutex>
+#include <mutex>
 #include <atomic>
 #include <utility>
 
 #include <boost/filesystem.hpp>
 #include <rs.hpp>
 
+#include "rs_frame_handle.h"
+#include "rs_convert.h"
+#include "rs_pointcloud.h"
+#include "rs_playback.h"
+#include "rs_recording.h"
+#include "rs_writer.h"
+#include "rs_metrics.h"
+#include "rs_capture.h"
+#include "rs_frame_ring.h"
+#include "rs_catalog.h"
+#include "rs_sync.h"
+#include "rs_registry.h"
+#include "rs_device_source.h"
+
 namespace fs = boost::filesystem;
 
 namespace rsw {
@@ -26,43 +39,151 @@ namespace rsw {
 
 		/// throws boost::filesystem::filesystem_error if unable to open directory
 		/// throws std::invalid_argument if directory does not exist
-		RealSenseWrapper(std::string directory);
+		/// ringCapacity is the number of recent frames per stream kept in memory for getFrame,
+		/// 0 serves every frame from the recording
+		RealSenseWrapper(std::string directory, DiskWriter::Config writerConfig = DiskWriter::Config(),
+			size_t ringCapacity = DEFAULT_RING_CAPACITY);
+
+		/// Same as above, but captures from the given sources instead of the connected cameras,
+		/// for example simulated devices. Takes ownership of the sources.
+		RealSenseWrapper(std::string directory, std::vector<DeviceSource*> sources,
+			DiskWriter::Config writerConfig = DiskWriter::Config(), size_t ringCapacity = DEFAULT_RING_CAPACITY);
 
 		~RealSenseWrapper();
 
 		/// Returns list of serial names each corresponding to a camera
 		std::vector<std::string>* getDeviceList();
 
+		/// Prints connected devices and available playback, read from the catalog
 		void printStatus();
 
+		/// Checks the recording catalog against the data directory and fixes stale entries,
+		/// or builds it from scratch if rebuild is set. Returns the number of stale entries.
+		int verifyCatalog(bool rebuild = false);
+
 		/// Returns frame at specified timestamp of specified stream, or the latest timestamp if
-		/// none specified.
+		/// none specified. mode selects an exact match or the floor/ceil/nearest frame.
+		/// Recent frames of streams being recorded are served from memory, older ones from
+		/// the memory mapped recording, neither is copied.
+		RSError getFrame(FrameHandle& frame, std::string serial, rs::stream strm,
+			std::string streamName, int timestamp = -1,
+			TimestampIndex::SeekMode mode = TimestampIndex::EXACT);
+
+		/// Same as above, but converts the frame to fmt, see convertFrame. Fails if the stream's
+		/// format cannot be converted. Frames already in fmt are not copied.
+		RSError getFrame(FrameHandle& frame, std::string serial, rs::stream strm,
+			std::string streamName, rs::format fmt, int timestamp = -1,
+			TimestampIndex::SeekMode mode = TimestampIndex::EXACT);
+
+		/// Same as the first getFrame, but copies the frame into a new vector that the caller must delete
 		RSError getFrame(std::vector<char>** data, std::string serial, rs::stream strm,
 			std::string streamName, int timestamp = -1);
 
+		/// Returns the calibration stored with a recording when its stream was configured
+		RSError getCalibration(StreamCalibration& calibration, std::string serial, rs::stream strm,
+			std::string streamName);
+
+		/// Deprojects a depth frame, live or recorded, into cloud, which must hold a point per
+		/// pixel of the depth stream. If colorName names a color recording of the same device,
+		/// points are in the color camera's coordinates and cloud.u and cloud.v are filled in.
+		/// timestamp and mode pick the depth frame as in getFrame.
+		RSError getPointCloud(const PointCloud& cloud, std::string serial, std::string depthName,
+			std::string colorName = "", int timestamp = -1,
+			TimestampIndex::SeekMode mode = TimestampIndex::EXACT);
+
+		/// Returns all recorded timestamps of a stream with from <= timestamp <= to
+		RSError getTimestamps(std::vector<int>& timestamps, std::string serial, rs::stream strm,
+			std::string streamName, int from, int to);
+
+		/// Rewrites the timestamp index of a recording that is not being written from its
+		/// segments or frame files
+		RSError rebuildIndex(std::string serial, rs::stream strm, std::string streamName);
+
+		/// Returns the frames of members captured together, in the order of members. A frame
+		/// is empty if its stream has none in the frameset. timestamp is on the clock of the
+		/// first member's device, -1 for the latest frameset. Framesets come from a sync
+		/// group containing all members, or if there is none and all members are on one
+		/// device, from matching timestamps of that device directly.
+		RSError getFrameset(std::vector<FrameHandle>& frames, int timestamp,
+			std::vector<StreamId> members, TimestampIndex::SeekMode mode = TimestampIndex::NEAREST);
+
+		/// Opens members for playback in timestamp order at rate times real time, 0 for as fast
+		/// as frames can be read, see PlaybackSession. Streams being recorded play up to
+		/// their latest frame. The caller must delete the session.
+		RSError openPlayback(PlaybackSession** session, std::vector<StreamId> members, double rate = 1.0,
+			size_t bufferFrames = DEFAULT_PLAYBACK_BUFFER);
+
+		/// Records which frames of members, on one or more devices, belong together while
+		/// they are captured. Frames more than tolerance ms apart on the host clock are not
+		/// grouped. The framesets are stored under the first member's device folder.
+		RSError addSyncGroup(std::string groupName, std::vector<StreamId> members,
+			int tolerance = DEFAULT_SYNC_TOLERANCE);
+
+		/// Stops grouping frames, framesets already recorded are kept
+		RSError removeSyncGroup(std::string groupName);
+
+		/// Starts recording a stream under streamName. Fails if the name is taken or the
+		/// stream is already enabled on the device in another mode.
 		RSError enableStream(std::string serial, rs::stream strm, std::string streamName,
 			int width, int height, rs::format fmt, int framerate);
 
+		/// Stops recording a stream, frames already captured are still written out
 		RSError disableStream(std::string serial, rs::stream strm, std::string streamName);
 
+		/// Returns queue depth, drop and write counters of the disk writer
+		DiskWriter::Stats getWriterStats();
+
+		/// Returns frame counters and latency summaries of every stream recorded so far
+		std::vector<StreamMetricsSnapshot> getMetrics();
+
+		/// Writes the metrics to file in the Prometheus text format every intervalMs until
+		/// stopped, for example for the node exporter's textfile collector
+		RSError startMetricsDump(std::string file, int intervalMs);
+		void stopMetricsDump();
+
+		/// Starts the capture thread of a device, enabled streams are recorded while it runs.
+		/// Also restarts a capture thread that stopped on an error, see printStatus
 		RSError startDevice(std::string serial);
 		
 		RSError stopDevice(std::string serial);
 
 	private:
-		rs::context ctx;
+		// nullptr when capturing from sources passed in
+		rs::context* ctx;
 		fs::path dataPath;
-		// map of serial strings to devices and mutexes and
-		// a map of stream types to thread pointers, last written timestamp, and whether to stop or not.
-		// maps to NULL tuple if device is disconnected
-		std::map<std::string,
-			std::tuple<rs::device*, std::mutex*,
-				std::map<rs::stream, std::tuple<std::thread*, int, bool>>>> _deviceMap;
-		std::shared_mutex _deviceMapM;
+		Catalog* _catalog;
+		// devices by serial, disconnected devices with recordings have no rs::device
+		ShardedMap<std::string, DeviceState> _devices;
+		// streams being recorded by recording folder
+		ShardedMap<fs::path, StreamState, PathHash> _streams;
+		// open readers of recordings by recording folder
+		ShardedMap<fs::path, ReaderState, PathHash> _readers;
+		// of every stream recorded, outlives the writer threads updating them
+		MetricsRegistry _metrics;
+		// writer threads that take captured frames off the capture threads
+		DiskWriter _diskWriter;
+		size_t _ringCapacity;
+		// sync groups by name, guarded by _syncM which also serializes changes to _syncTargets
+		std::map<std::string, std::shared_ptr<FrameSynchronizer>> _syncGroups;
+		std::mutex _syncM;
+		// sync groups fed by each recording folder, looked up for every captured frame
+		ShardedMap<fs::path, const SyncTargets, PathHash> _syncTargets;
+		// open frameset files
+		std::map<fs::path, FramesetReader*> _framesetReaders;
+		std::mutex _framesetsM;
+		// point cloud generators by depth and color recording folder, built on first use
+		std::map<std::pair<fs::path, fs::path>, std::shared_ptr<PointCloudGenerator>> _pointClouds;
+		std::mutex _pointCloudsM;
 
 		void overwatchLoop();
-		void writeImgLoop(fs::path p, std::string serial, rs::stream strm,
-			int width, int height, rs::format fmt, int framerate);
+		void open(const std::vector<DeviceSource*>& sources);
+		std::shared_ptr<ReaderState> openReader(const fs::path& p);
+		fs::path framesetPath(const std::string& serial, const std::string& groupName);
+		/// Looks for a recorded frameset of members, _framesetsM must be held
+		bool findFrameset(int timestamp, const std::vector<StreamId>& members,
+			TimestampIndex::SeekMode mode, std::vector<int>& timestamps);
+		/// Called on the capture thread of the stream's device
+		void writeFrame(StreamState& stream, int timestamp, const void* data);
 	};
 }
 
@@ -0,0 +1,430 @@
+#include <algorithm>
+
+#include "rs_log.h"
+#include "rs_writer.h"
+
+namespace rsw {
+	FramePool::State::~State() {
+		for (auto frame : free) {
+			delete frame;
+		}
+	}
+
+	FramePool::FramePool(size_t frameCount, size_t frameCapacity) :
+						 _state(new State()), _frameCapacity(frameCapacity) {
+		_state->allocations = 0;
+		_state->excess = 0;
+		reserve(frameCount, frameCapacity);
+	}
+
+	std::shared_ptr<Frame> FramePool::acquire(size_t size) {
+		Frame* frame = nullptr;
+		_state->m.lock();
+		if (!_state->free.empty()) {
+			frame = _state->free.back();
+			_state->free.pop_back();
+		}
+		_state->m.unlock();
+
+		if (frame == nullptr) {
+			frame = new Frame();
+			frame->data.reserve(std::max(size, _frameCapacity));
+			++_state->allocations;
+		}
+		frame->close = false;
+		frame->metrics = nullptr;
+		frame->captured = std::chrono::steady_clock::now();
+		frame->data.resize(size);
+
+		// Frames hold on to the pool state so they can outlive the pool itself
+		std::shared_ptr<State> state = _state;
+		return std::shared_ptr<Frame>(frame, [state](Frame* f) {
+			f->recording.clear();
+			state->m.lock();
+			bool keep = state->excess == 0;
+			if (keep) {
+				state->free.push_back(f);
+			} else {
+				--state->excess;
+			}
+			state->m.unlock();
+			if (!keep) {
+				delete f;
+			}
+		});
+	}
+
+	void FramePool::reserve(size_t count, size_t size) {
+		std::vector<Frame*> frames;
+		_state->m.lock();
+		// frames still owed from a release are kept instead
+		size_t kept = std::min(count, _state->excess);
+		_state->excess -= kept;
+		_state->m.unlock();
+
+		for (size_t i = kept; i < count; ++i) {
+			Frame* frame = new Frame();
+			frame->data.reserve(std::max(size, _frameCapacity));
+			frames.push_back(frame);
+		}
+		std::lock_guard<std::mutex> lock(_state->m);
+		_state->free.insert(_state->free.end(), frames.begin(), frames.end());
+	}
+
+	void FramePool::release(size_t count) {
+		std::vector<Frame*> frames;
+		_state->m.lock();
+		size_t n = std::min(count, _state->free.size());
+		frames.assign(_state->free.end() - n, _state->free.end());
+		_state->free.resize(_state->free.size() - n);
+		_state->excess += count - n;
+		_state->m.unlock();
+
+		for (auto frame : frames) {
+			delete frame;
+		}
+	}
+
+	FrameQueue::FrameQueue(size_t capacity, Policy policy) :
+						   _ring(capacity), _head(0), _count(0), _policy(policy),
+						   _shutdown(false), _maxDepth(0), _dropped(0) {
+	}
+
+	bool FrameQueue::push(std::shared_ptr<Frame> frame) {
+		// only measured frames pay for reading the clock
+		StreamMetrics* metrics = frame->metrics;
+		std::chrono::steady_clock::time_point start;
+		if (metrics != nullptr) {
+			start = std::chrono::steady_clock::now();
+		}
+
+		// keep a dropped frame alive until we are outside the lock, its deleter takes the pool lock
+		std::shared_ptr<Frame> dropped;
+		std::unique_lock<std::mutex> lock(_m);
+		if (_count == _ring.size()) {
+			// close markers are never dropped, an incoming one waits for space and evictions
+			// pass over queued ones
+			Policy policy = frame->close ? BLOCK : _policy;
+			size_t victim = 0;
+			if (policy == DROP_OLDEST) {
+				while (victim < _count && _ring[(_head + victim) % _ring.size()]->close) {
+					++victim;
+				}
+				if (victim == _count) {
+					policy = BLOCK;
+				}
+			}
+			switch (policy) {
+			case BLOCK:
+				_notFull.wait(lock, [this] { return _count < _ring.size() || _shutdown; });
+				break;
+			case DROP_OLDEST:
+				dropped = std::move(_ring[(_head + victim) % _ring.size()]);
+				// close the gap by moving the markers ahead of the victim up by one
+				for (size_t i = victim; i > 0; --i) {
+					_ring[(_head + i) % _ring.size()] = std::move(_ring[(_head + i - 1) % _ring.size()]);
+				}
+				_head = (_head + 1) % _ring.size();
+				--_count;
+				++_dropped;
+				if (dropped->metrics != nullptr) {
+					dropped->metrics->count(FRAMES_DROPPED);
+				}
+				break;
+			case DROP_NEWEST:
+				++_dropped;
+				if (metrics != nullptr) {
+					metrics->count(FRAMES_DROPPED);
+				}
+				return false;
+			}
+		}
+		if (_shutdown) {
+			// nobody is left to write the frame, it counts as dropped like any other lost one
+			if (!frame->close) {
+				++_dropped;
+				if (metrics != nullptr) {
+					metrics->count(FRAMES_DROPPED);
+				}
+			}
+			return false;
+		}
+
+		size_t depth = _count;
+		_ring[(_head + _count) % _ring.size()] = std::move(frame);
+		++_count;
+		if (_count > _maxDepth) {
+			_maxDepth = _count;
+		}
+		std::chrono::steady_clock::time_point queued;
+		if (metrics != nullptr) {
+			queued = std::chrono::steady_clock::now();
+		}
+		lock.unlock();
+		_notEmpty.notify_one();
+
+		if (metrics != nullptr) {
+			metrics->record(LOCK_WAIT_NS, std::chrono::duration_cast<std::chrono::nanoseconds>(queued - start).count());
+			metrics->record(QUEUE_DEPTH, depth);
+		}
+		return dropped == nullptr;
+	}
+
+	bool FrameQueue::popBatch(std::vector<std::shared_ptr<Frame>>& out, size_t max,
+			std::chrono::steady_clock::time_point until) {
+		std::unique_lock<std::mutex> lock(_m);
+		auto ready = [this] { return _count > 0 || _shutdown; };
+		if (until == std::chrono::steady_clock::time_point::max()) {
+			_notEmpty.wait(lock, ready);
+		} else if (!_notEmpty.wait_until(lock, until, ready)) {
+			return true;
+		}
+		if (_count == 0) {
+			return false;
+		}
+		size_t n = std::min(std::max<size_t>(max, 1), _count);
+		for (size_t i = 0; i < n; ++i) {
+			out.push_back(std::move(_ring[_head]));
+			_head = (_head + 1) % _ring.size();
+		}
+		_count -= n;
+		lock.unlock();
+		_notFull.notify_all();
+		return true;
+	}
+
+	void FrameQueue::shutdown() {
+		_m.lock();
+		_shutdown = true;
+		_m.unlock();
+		_notEmpty.notify_all();
+		_notFull.notify_all();
+	}
+
+	size_t FrameQueue::getDepth() {
+		std::lock_guard<std::mutex> lock(_m);
+		return _count;
+	}
+
+	DiskWriter::DiskWriter(Config config) :
+						   _config(config),
+						   _pool(config.threads * (config.queueCapacity + std::max<size_t>(config.batchSize, 1)),
+								 config.frameCapacity),
+						   _queues(), _threads(), _written(), _closed(), _writtenM(),
+						   _writtenCount(0), _writeErrors(0), _rawBytes(0), _storedBytes(0), _latency() {
+		for (int i = 0; i < _config.threads; ++i) {
+			_queues.push_back(new FrameQueue(_config.queueCapacity, _config.policy));
+		}
+		for (auto queue : _queues) {
+			_threads.push_back(new std::thread(&DiskWriter::writeLoop, this, queue));
+		}
+	}
+
+	DiskWriter::~DiskWriter() {
+		shutdown();
+		for (auto queue : _queues) {
+			delete queue;
+		}
+	}
+
+	void DiskWriter::shutdown() {
+		for (auto queue : _queues) {
+			queue->shutdown();
+		}
+		for (auto thread : _threads) {
+			thread->join();
+			delete thread;
+		}
+		_threads.clear();
+	}
+
+	std::shared_ptr<Frame> DiskWriter::acquireFrame(size_t size) {
+		return _pool.acquire(size);
+	}
+
+	void DiskWriter::reserveFrames(size_t count, size_t size) {
+		_pool.reserve(count, size);
+	}
+
+	void DiskWriter::releaseFrames(size_t count) {
+		_pool.release(count);
+	}
+
+	FrameQueue* DiskWriter::queueFor(const fs::path& recording) {
+		// recordings are <serial>/<stream>/<name>, all streams of a device are batched together
+		fs::path device = recording.parent_path().parent_path();
+		return _queues[std::hash<std::string>()(device.string()) % _queues.size()];
+	}
+
+	bool DiskWriter::submit(std::shared_ptr<Frame> frame) {
+		FrameQueue* queue = queueFor(frame->recording);
+		return queue->push(std::move(frame));
+	}
+
+	void DiskWriter::closeRecording(const fs::path& recording) {
+		auto marker = _pool.acquire(0);
+		marker->recording = recording;
+		marker->close = true;
+		// queues never drop close markers, this only fails once the writer is shut down
+		queueFor(recording)->push(marker);
+	}
+
+	void DiskWriter::setWrittenCallback(std::function<void(const fs::path&, int)> callback) {
+		std::lock_guard<std::mutex> lock(_writtenM);
+		_written = callback;
+	}
+
+	void DiskWriter::setClosedCallback(std::function<void(const fs::path&)> callback) {
+		std::lock_guard<std::mutex> lock(_writtenM);
+		_closed = callback;
+	}
+
+	DiskWriter::Stats DiskWriter::getStats() {
+		Stats stats = { 0, 0, 0, _writtenCount, _writeErrors, _pool.getAllocationCount(),
+			_rawBytes, _storedBytes, _latency.percentile(0.5), _latency.percentile(0.9),
+			_latency.percentile(0.99), _latency.getMax() };
+		for (auto queue : _queues) {
+			stats.queueDepth += queue->getDepth();
+			stats.maxQueueDepth = std::max(stats.maxQueueDepth, queue->getMaxDepth());
+			stats.dropped += queue->getDropCount();
+		}
+		return stats;
+	}
+
+	void DiskWriter::writeLoop(FrameQueue* queue) {
+		// Segment writers are owned by this thread only
+		std::map<fs::path, SegmentWriter*> writers;
+		FrameCodec* codec = getCodec(_config.compression);
+		std::vector<std::shared_ptr<Frame>> batch;
+		// frames of the batch per recording, in queue order
+		std::map<fs::path, std::vector<Frame*>> pending;
+		std::vector<SegmentRecord> records;
+		std::vector<std::vector<char>> encoded;
+
+		auto writePending = [&](const fs::path& recording, std::vector<Frame*>& frames) {
+			if (frames.empty()) {
+				return;
+			}
+			auto it = writers.find(recording);
+			if (it == writers.end()) {
+				try {
+					it = writers.emplace(recording,
+						new SegmentWriter(recording, _config.segmentSize, _config.io)).first;
+				} catch (const fs::filesystem_error& e) {
+					RSW_LOG(LOG_ERROR, e.what());
+					_writeErrors += frames.size();
+					if (frames[0]->metrics != nullptr) {
+						frames[0]->metrics->count(WRITE_ERRORS, frames.size());
+					}
+					frames.clear();
+					return;
+				}
+			}
+
+			records.clear();
+			if (encoded.size() < frames.size()) {
+				encoded.resize(frames.size());
+			}
+			for (size_t i = 0; i < frames.size(); ++i) {
+				Frame* frame = frames[i];
+				SegmentRecord record = { frame->timestamp, frame->stream, frame->format, frame->width,
+					frame->height, frame->data.data(), (uint32_t)frame->data.size(), CODEC_NONE };
+				// frames that do not shrink are stored raw
+				if (codec != nullptr && codec->supports(frame->format) && codec->encode(frame->data.data(),
+						frame->data.size(), frame->width, frame->height, encoded[i])) {
+					record.data = encoded[i].data();
+					record.size = (uint32_t)encoded[i].size();
+					record.flags = codec->getId();
+				}
+				records.push_back(record);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			size_t written = it->second->append(records.data(), records.size());
+			auto now = std::chrono::steady_clock::now();
+			// frames of one recording share their metrics
+			StreamMetrics* metrics = frames[0]->metrics;
+			uint64_t stored = 0;
+			for (size_t i = 0; i < written; ++i) {
+				uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+					now - frames[i]->captured).count();
+				_rawBytes += frames[i]->data.size();
+				stored += records[i].size;
+				_latency.record(latency);
+				if (metrics != nullptr) {
+					metrics->record(CAPTURE_TO_WRITE_US, latency);
+				}
+			}
+			_storedBytes += stored;
+			_writtenCount += written;
+			_writeErrors += frames.size() - written;
+			if (metrics != nullptr) {
+				metrics->record(WRITE_US, std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+				metrics->count(FRAMES_WRITTEN, written);
+				metrics->count(BYTES_WRITTEN, stored);
+				if (written < frames.size()) {
+					metrics->count(WRITE_ERRORS, frames.size() - written);
+				}
+			}
+			RSW_LOG(LOG_TRACE, "Wrote " << written << " of " << frames.size() << " frames to " << recording);
+			{
+				std::lock_guard<std::mutex> lock(_writtenM);
+				if (_written) {
+					for (size_t i = 0; i < written; ++i) {
+						_written(recording, frames[i]->timestamp);
+					}
+				}
+			}
+			frames.clear();
+		};
+
+		while (true) {
+			// a time based sync must not wait for the next frame of an idle recording
+			auto until = std::chrono::steady_clock::time_point::max();
+			for (auto& writer : writers) {
+				until = std::min(until, writer.second->getSyncDeadline());
+			}
+			if (!queue->popBatch(batch, _config.batchSize, until)) {
+				break;
+			}
+			if (batch.empty()) {
+				for (auto& writer : writers) {
+					writer.second->syncIfDue();
+				}
+				continue;
+			}
+
+			for (auto& frame : batch) {
+				if (!frame->close) {
+					pending[frame->recording].push_back(frame.get());
+					continue;
+				}
+
+				// everything queued before the close marker goes out first
+				auto p = pending.find(frame->recording);
+				if (p != pending.end()) {
+					writePending(p->first, p->second);
+					pending.erase(p);
+				}
+				auto it = writers.find(frame->recording);
+				if (it != writers.end()) {
+					delete it->second;
+					writers.erase(it);
+				}
+				std::lock_guard<std::mutex> lock(_writtenM);
+				if (_closed) {
+					_closed(frame->recording);
+				}
+			}
+			for (auto& p : pending) {
+				writePending(p.first, p.second);
+			}
+			// returns the frames to the pool
+			batch.clear();
+		}
+
+		for (auto writer : writers) {
+			delete writer.second;
+		}
+	}
+}
@@ -0,0 +1,194 @@
+#ifndef RSWRITER_H
+#define RSWRITER_H
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+#include <boost/filesystem.hpp>
+#include <rs.hpp>
+
+#include "rs_recording.h"
+#include "rs_histogram.h"
+#include "rs_metrics.h"
+
+namespace fs = boost::filesystem;
+
+namespace rsw {
+	/// A captured frame on its way to disk. Buffers come from a FramePool and go back to it
+	/// when the last shared_ptr referencing them is dropped.
+	struct Frame {
+		fs::path recording;
+		rs::stream stream;
+		rs::format format;
+		int width;
+		int height;
+		int timestamp;
+		// when the frame was taken from the pool, which is as it is captured
+		std::chrono::steady_clock::time_point captured;
+		// marks the end of a recording, no payload
+		bool close;
+		// of the frame's stream, nullptr if it is not measured. Must outlive the frame.
+		StreamMetrics* metrics;
+		std::vector<char> data;
+	};
+
+	/// Fixed set of preallocated frame buffers that are recycled instead of freed.
+	/// Allocates a new buffer only if every pooled one is in use.
+	class FramePool {
+	public:
+		FramePool(size_t frameCount, size_t frameCapacity);
+
+		/// Returns a frame whose data holds size bytes of uninitialized payload
+		std::shared_ptr<Frame> acquire(size_t size);
+		/// Adds count frames of at least size bytes, for frames held outside the writer
+		void reserve(size_t count, size_t size);
+		/// Takes count frames out of the pool again, frames in use are freed once returned
+		void release(size_t count);
+
+		uint64_t getAllocationCount() const { return _state->allocations; }
+
+	private:
+		struct State {
+			std::mutex m;
+			std::vector<Frame*> free;
+			std::atomic<uint64_t> allocations;
+			// frames to free instead of returning them to the pool
+			size_t excess;
+			~State();
+		};
+		std::shared_ptr<State> _state;
+		size_t _frameCapacity;
+	};
+
+	/// Bounded multi-producer queue of frames with a configurable overflow policy. Close
+	/// markers are exempt from it, they are never dropped. Pushes record their wait, the
+	/// queue depth and drops in the metrics of the frames involved.
+	class FrameQueue {
+	public:
+		enum Policy {
+			BLOCK = 0,   // producer waits for space
+			DROP_OLDEST, // oldest queued frame is discarded
+			DROP_NEWEST  // incoming frame is discarded
+		};
+
+		FrameQueue(size_t capacity, Policy policy);
+
+		/// Returns false if a frame was dropped to make the push possible or the push itself
+		/// was dropped
+		bool push(std::shared_ptr<Frame> frame);
+		/// Blocks until a frame is available, then moves up to max queued frames to out.
+		/// Returns false once shut down and empty, true with out left empty if until passed
+		/// first.
+		bool popBatch(std::vector<std::shared_ptr<Frame>>& out, size_t max,
+			std::chrono::steady_clock::time_point until = std::chrono::steady_clock::time_point::max());
+		void shutdown();
+
+		size_t getDepth();
+		size_t getMaxDepth() const { return _maxDepth; }
+		uint64_t getDropCount() const { return _dropped; }
+
+	private:
+		std::vector<std::shared_ptr<Frame>> _ring;
+		size_t _head;
+		size_t _count;
+		Policy _policy;
+		bool _shutdown;
+		std::mutex _m;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+		std::atomic<size_t> _maxDepth;
+		std::atomic<uint64_t> _dropped;
+	};
+
+	/// Pool of writer threads that take frames off bounded queues and append them to
+	/// segment files. Frames of one device always go to the same thread so they are
+	/// written in order without locking the SegmentWriter. A thread takes everything queued,
+	/// up to batchSize frames, and writes each recording's share with a single write, so
+	/// batches grow under load while a lone frame is still written right away.
+	class DiskWriter {
+	public:
+		struct Config {
+			int threads = 2;
+			size_t queueCapacity = 64;
+			FrameQueue::Policy policy = FrameQueue::BLOCK;
+			size_t frameCapacity = 640 * 480 * 4;
+			uint64_t segmentSize = DEFAULT_SEGMENT_SIZE;
+			// CodecId applied to frames whose format the codec supports
+			uint32_t compression = CODEC_NONE;
+			// most frames a writer thread writes at once
+			size_t batchSize = 32;
+			WriteOptions io;
+		};
+
+		struct Stats {
+			size_t queueDepth;
+			size_t maxQueueDepth;
+			uint64_t dropped;
+			uint64_t written;
+			uint64_t writeErrors;
+			uint64_t poolAllocations;
+			// payload bytes before and after compression
+			uint64_t rawBytes;
+			uint64_t storedBytes;
+			// capture to disk latency of written frames, microseconds
+			uint64_t latencyP50;
+			uint64_t latencyP90;
+			uint64_t latencyP99;
+			uint64_t latencyMax;
+		};
+
+		DiskWriter(Config config);
+		/// Writes out everything still queued before returning
+		~DiskWriter();
+
+		/// Writes out everything still queued and stops the writer threads, frames submitted
+		/// afterwards are dropped
+		void shutdown();
+
+		/// Returns an empty frame from the pool to be filled and passed to submit()
+		std::shared_ptr<Frame> acquireFrame(size_t size);
+		/// Grows the pool by count frames of size bytes, for frames the caller keeps after
+		/// submitting them, such as those in a FrameRing
+		void reserveFrames(size_t count, size_t size);
+		/// Undoes reserveFrames once the caller no longer keeps those frames
+		void releaseFrames(size_t count);
+		/// Returns false if the frame or an older one was dropped
+		bool submit(std::shared_ptr<Frame> frame);
+		/// Closes the segment files of a recording after its queued frames are written
+		void closeRecording(const fs::path& recording);
+
+		/// Called from writer threads after a frame is on disk
+		void setWrittenCallback(std::function<void(const fs::path&, int)> callback);
+		/// Called from writer threads once a recording's segment files are closed
+		void setClosedCallback(std::function<void(const fs::path&)> callback);
+
+		Stats getStats();
+
+	private:
+		Config _config;
+		FramePool _pool;
+		std::vector<FrameQueue*> _queues;
+		std::vector<std::thread*> _threads;
+		std::function<void(const fs::path&, int)> _written;
+		std::function<void(const fs::path&)> _closed;
+		std::mutex _writtenM;
+		std::atomic<uint64_t> _writtenCount;
+		std::atomic<uint64_t> _writeErrors;
+		std::atomic<uint64_t> _rawBytes;
+		std::atomic<uint64_t> _storedBytes;
+		Histogram _latency;
+
+		FrameQueue* queueFor(const fs::path& recording);
+		void writeLoop(FrameQueue* queue);
+	};
+}
+
+#endif